@@ -0,0 +1,281 @@
+#include "vulkan_display.h"
+#include "vulkan_display_detail.h"
+#include "bc1_encoder.h"
+#include "transfer_pool_sizer.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace vulkan_display_detail;
+namespace vkd = vulkan_display;
+
+namespace {
+
+// every benchmarked function runs on the cpu only, no vulkan device is created
+
+void concurrent_queue_push_pop(benchmark::State& state) {
+        static concurrent_queue<int> queue;
+        for (auto _ : state) {
+                queue.push(1);
+                benchmark::DoNotOptimize(queue.pop());
+        }
+        state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(concurrent_queue_push_pop)->ThreadRange(1, 8)->UseRealTime();
+
+/// thread 0 is the consumer of items pushed by all other threads, like the display thread with producers
+void concurrent_queue_producers(benchmark::State& state) {
+        static concurrent_queue<int> queue;
+        for (auto _ : state) {
+                if (state.thread_index() == 0) {
+                        for (int i = 1; i < state.threads(); i++) {
+                                benchmark::DoNotOptimize(queue.pop());
+                        }
+                } else {
+                        queue.push(1);
+                }
+        }
+        state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(concurrent_queue_producers)->Threads(2)->Threads(3)->Threads(5)->Threads(9)->UseRealTime();
+
+/// transfer images with preallocated memory, enough for the queue operations of acquire_transfer_image
+struct transfer_image_pool {
+        std::vector<transfer_image> images;
+        std::vector<std::vector<std::byte>> memory;
+
+        transfer_image_pool(size_t count, uint32_t width, uint32_t height) :
+                images(count),
+                memory(count, std::vector<std::byte>(size_t{ width } * height * 4))
+        {
+                for (size_t i = 0; i < count; i++) {
+                        images[i].id = static_cast<uint32_t>(i);
+                        images[i].ptr = memory[i].data();
+                        images[i].row_pitch = width * 4;
+                        images[i].description = vkd::image_description{ width, height };
+                }
+        }
+};
+
+/// the requested description is at the back of the available queue, the others are searched first
+void acquire_transfer_image_available(benchmark::State& state) {
+        transfer_image_pool pool(static_cast<size_t>(state.range(0)), 16, 16);
+        vkd::image_description requested{ 1280, 720 };
+        for (auto& image : pool.images) {
+                image.description = vkd::image_description{ 1920, 1080 };
+        }
+        pool.images.back().description = requested;
+        concurrent_queue<transfer_image*> available_img_queue;
+        concurrent_queue<vkd::image> filled_img_queue;
+        for (auto& image : pool.images) {
+                available_img_queue.push(&image);
+        }
+        bool dropped = false;
+        for (auto _ : state) {
+                auto* acquired = acquire_transfer_image(available_img_queue, filled_img_queue, 1,
+                        requested, std::nullopt, dropped);
+                benchmark::DoNotOptimize(acquired);
+                available_img_queue.push(acquired);
+        }
+        state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(acquire_transfer_image_available)->Arg(3)->Arg(8)->Arg(16);
+
+/// no image is available and the display is behind, so the oldest queued image is stolen
+void acquire_transfer_image_stolen(benchmark::State& state) {
+        constexpr unsigned filled_img_max_count = 2;
+        transfer_image_pool pool(filled_img_max_count + 1, 16, 16);
+        concurrent_queue<transfer_image*> available_img_queue;
+        concurrent_queue<vkd::image> filled_img_queue;
+        for (auto& image : pool.images) {
+                filled_img_queue.push(vkd::image{ image });
+        }
+        bool dropped = false;
+        for (auto _ : state) {
+                auto* acquired = acquire_transfer_image(available_img_queue, filled_img_queue,
+                        filled_img_max_count, pool.images[0].description, std::nullopt, dropped);
+                filled_img_queue.push(vkd::image{ *acquired });
+        }
+        state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(acquire_transfer_image_stolen);
+
+/**
+ * Thread 0 is the display thread returning displayed images, the other threads are producers queueing 720p frames.
+ * The wait of a producer for the gpu to release its image is modelled by a sleep. With Arg(1) producers wait
+ * with device_mutex locked like before the producers were moved off it, so they are serialized with each other
+ * and with the display. With Arg(0) frames per second should grow with the number of producers.
+ * Frames are allocated once and only their first bytes are written, so the queues and locks are measured.
+ */
+void producer_throughput(benchmark::State& state) {
+        constexpr uint32_t width = 1280;
+        constexpr uint32_t height = 720;
+        constexpr size_t image_count = 8;
+        constexpr auto gpu_wait = std::chrono::microseconds{ 100 };
+        static std::mutex device_mutex;
+        static transfer_image_pool* pool = nullptr;
+        static concurrent_queue<transfer_image*> available_img_queue;
+        static concurrent_queue<vkd::image> filled_img_queue;
+        bool locked_wait = state.range(0) != 0;
+        if (state.thread_index() == 0) {
+                pool = new transfer_image_pool(image_count, width, height);
+                for (auto& image : pool->images) {
+                        available_img_queue.push(&image);
+                }
+        }
+        bool dropped = false;
+        uint64_t frame_number = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (auto _ : state) {
+                if (state.thread_index() == 0) {
+                        for (int i = 1; i < state.threads(); i++) {
+                                auto image = filled_img_queue.pop();
+                                std::scoped_lock lock(device_mutex);
+                                available_img_queue.push(image.get_transfer_image());
+                        }
+                } else {
+                        // no queued image is stolen, so the display pops every frame
+                        auto* acquired = acquire_transfer_image(available_img_queue, filled_img_queue,
+                                image_count, vkd::image_description{ width, height }, std::nullopt, dropped);
+                        {
+                                std::unique_lock lock(device_mutex, std::defer_lock);
+                                if (locked_wait) {
+                                        lock.lock();
+                                }
+                                std::this_thread::sleep_for(gpu_wait);
+                        }
+                        vkd::image image{ *acquired };
+                        frame_number++;
+                        std::memcpy(image.get_memory_ptr(), &frame_number, sizeof(frame_number));
+                        filled_img_queue.push(image);
+                }
+        }
+        if (state.thread_index() == 0) {
+                // rates of the library are per thread, frames of all producers are counted here
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+                state.counters["frames_per_second"] =
+                        static_cast<double>(state.iterations()) * (state.threads() - 1) / elapsed.count();
+                available_img_queue.get_underlying_deque().second.clear();
+                delete pool;
+                pool = nullptr;
+        }
+}
+BENCHMARK(producer_throughput)
+        ->Arg(0)->Arg(1)->Threads(2)->Threads(3)->Threads(5)->Threads(9)->UseRealTime();
+
+void render_area_viewport_scissor(benchmark::State& state) {
+        vk::Extent2D window_size{ static_cast<uint32_t>(state.range(0)), static_cast<uint32_t>(state.range(1)) };
+        bool integer_scaling = state.range(2) != 0;
+        vkd::image_transform transform{};
+        transform.rotation = vkd::image_rotation::clockwise_90;
+        render_area area{};
+        vk::Viewport viewport;
+        vk::Rect2D scissor;
+        // sizes of the image alternate, so the result cannot be hoisted out of the loop
+        std::array<vk::Extent2D, 3> image_sizes{ vk::Extent2D{ 1920, 1080 }, { 720, 576 }, { 3840, 2160 } };
+        size_t i = 0;
+        for (auto _ : state) {
+                update_render_area_viewport_scissor(area, viewport, scissor, window_size,
+                        image_sizes[i++ % image_sizes.size()], transform, integer_scaling);
+                benchmark::DoNotOptimize(area);
+                benchmark::DoNotOptimize(viewport);
+                benchmark::DoNotOptimize(scissor);
+        }
+        state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(render_area_viewport_scissor)->Args({ 1920, 1080, 0 })->Args({ 1920, 1080, 1 })->Args({ 2560, 1080, 0 });
+
+/// RGBA8 frame with rows of blocks written into a tightly packed buffer
+void encode_bc1_frame(benchmark::State& state) {
+        auto width = static_cast<uint32_t>(state.range(0));
+        auto height = static_cast<uint32_t>(state.range(1));
+        auto thread_count = static_cast<uint32_t>(state.range(2));
+        size_t pixel_row_pitch = size_t{ width } * 4;
+        std::vector<std::byte> pixels(pixel_row_pitch * height);
+        for (size_t i = 0; i < pixels.size(); i++) {
+                pixels[i] = static_cast<std::byte>((i * 7) ^ (i >> 11));
+        }
+        size_t block_row_pitch = size_t{ (width + 3) / 4 } * 8;
+        std::vector<std::byte> blocks(block_row_pitch * ((height + 3) / 4));
+        for (auto _ : state) {
+                vkd::encode_bc1(pixels.data(), pixel_row_pitch, width, height, blocks.data(), block_row_pitch, thread_count);
+                benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * pixels.size()));
+}
+BENCHMARK(encode_bc1_frame)
+        ->Args({ 1920, 1080, 1 })->Args({ 1920, 1080, 4 })->Args({ 3840, 2160, 1 })->Args({ 3840, 2160, 4 })
+        ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/**
+ * Copy of a tightly packed RGBA8 frame into a transfer image with the given row pitch,
+ * rows are copied one by one unless the pitch equals the row size
+ */
+void frame_copy(benchmark::State& state) {
+        auto width = static_cast<size_t>(state.range(0));
+        auto height = static_cast<size_t>(state.range(1));
+        size_t row_size = width * 4;
+        size_t row_pitch = row_size + static_cast<size_t>(state.range(2));
+        std::vector<std::byte> source(row_size * height, std::byte{ 1 });
+        std::vector<std::byte> destination(row_pitch * height);
+        for (auto _ : state) {
+                if (row_pitch == row_size) {
+                        std::memcpy(destination.data(), source.data(), source.size());
+                } else {
+                        for (size_t row = 0; row < height; row++) {
+                                std::memcpy(destination.data() + row * row_pitch, source.data() + row * row_size, row_size);
+                        }
+                }
+                benchmark::ClobberMemory();
+        }
+        state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * source.size()));
+}
+BENCHMARK(frame_copy)
+        ->Args({ 1920, 1080, 0 })->Args({ 1920, 1080, 256 })->Args({ 3840, 2160, 0 })->Args({ 3840, 2160, 256 })
+        ->Unit(benchmark::kMicrosecond);
+
+/// every producer records its acquire, one of them evaluates the interval like acquire_image does
+void transfer_pool_sizer_record(benchmark::State& state) {
+        static transfer_pool_sizer sizer;
+        if (state.thread_index() == 0) {
+                sizer.init(2, 8, 4);
+        }
+        for (auto _ : state) {
+                auto now = transfer_pool_sizer::clock::now();
+                sizer.record_acquire(std::chrono::microseconds{ 10 }, 2, false);
+                benchmark::DoNotOptimize(sizer.evaluate(now));
+        }
+        state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(transfer_pool_sizer_record)->ThreadRange(1, 8)->UseRealTime();
+
+} // namespace
+
+int main(int argc, char** argv) {
+        // results are written as JSON, so runs can be compared, unless another output file is given
+        std::string output_argument = "--benchmark_out=benchmark_results.json";
+        std::string format_argument = "--benchmark_out_format=json";
+        std::vector<char*> arguments(argv, argv + argc);
+        bool has_output = std::any_of(arguments.begin() + 1, arguments.end(),
+                [](const char* argument) { return std::strncmp(argument, "--benchmark_out=", 16) == 0; });
+        if (!has_output) {
+                arguments.push_back(output_argument.data());
+                arguments.push_back(format_argument.data());
+        }
+        int argument_count = static_cast<int>(arguments.size());
+        benchmark::Initialize(&argument_count, arguments.data());
+        if (benchmark::ReportUnrecognizedArguments(argument_count, arguments.data())) {
+                return 1;
+        }
+        benchmark::RunSpecifiedBenchmarks();
+        benchmark::Shutdown();
+        return 0;
+}
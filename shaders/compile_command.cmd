@@ -1,3 +1,6 @@
 glslc.exe vulkan_shader.vert -o vert.spv
 glslc.exe vulkan_shader.frag -o frag.spv
+glslc.exe tile_shader.vert -o tile_vert.spv
+glslc.exe tile_shader.frag -o tile_frag.spv
+glslc.exe deinterlace.comp -o deinterlace.spv
 pause
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 450
+
+layout(binding = 0) uniform sampler2DArray tiles;
+
+layout(location = 0) in vec3 tex_coord;
+layout(location = 1) flat in vec4 tex_bounds;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // texels of a border tile past the image are left from the previous tile of the layer, they are never filtered in
+    outColor = texture(tiles, vec3(clamp(tex_coord.xy, tex_bounds.xy, tex_bounds.zw), tex_coord.z));
+}
@@ -0,0 +1,26 @@
+#version 450
+
+// instance attributes, one instance for every visible tile
+layout(location = 0) in vec4 screen_rect;    // x, y, width, height in normalized device coordinates
+layout(location = 1) in vec4 texture_rect;   // u, v, width, height inside the cached tile
+layout(location = 2) in float layer;         // layer of the tile cache
+layout(location = 3) in vec4 texture_bounds; // u, v minimum and maximum half a texel inside the uploaded texels
+
+layout(location = 0) out vec3 tex_coord;
+layout(location = 1) flat out vec4 tex_bounds;
+
+vec2 corners[6] = vec2[](
+    vec2(0.0, 0.0),
+    vec2(0.0, 1.0),
+    vec2(1.0, 1.0),
+    vec2(1.0, 1.0),
+    vec2(1.0, 0.0),
+    vec2(0.0, 0.0)
+);
+
+void main() {
+    vec2 corner = corners[gl_VertexIndex];
+    gl_Position = vec4(screen_rect.xy + corner * screen_rect.zw, 0.0, 1.0);
+    tex_coord = vec3(texture_rect.xy + corner * texture_rect.zw, layer);
+    tex_bounds = texture_bounds;
+}
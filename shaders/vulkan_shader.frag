@@ -1,19 +1,232 @@
 #version 450
 
+// values of vulkan_display::scaling_filter
+const uint FILTER_NEAREST = 0;
+const uint FILTER_INTEGER = 1;
+const uint FILTER_BILINEAR = 2;
+const uint FILTER_BICUBIC = 3;
+const uint FILTER_LANCZOS3 = 4;
+const uint FILTER_EDGE_ADAPTIVE = 5;
+
+// lut_mode is 0 or value of vulkan_display::lut_interpolation + 1
+const uint LUT_DISABLED = 0;
+const uint LUT_TRILINEAR = 1;
+const uint LUT_TETRAHEDRAL = 2;
+
+layout(constant_id = 0) const uint scaling_filter = FILTER_BILINEAR;
+
 layout( push_constant ) uniform constants
 {
 	uint x;
 	uint y;
 	uint width;
 	uint height;
+	float alpha; // multiplies alpha of the texture, used for blending of overlays
+	uint lut_mode;
+	uint lut_srgb; // the texture is sampled linearized, the LUT expects sRGB encoded values
+	float lut_size;
+	float lut_domain_min[3];
+	float lut_domain_scale[3];
+	float uv_transform_x[3]; // crop, rotation and flips of the image, uv = (dot(x, (u, v, 1)), dot(y, (u, v, 1)))
+	float uv_transform_y[3];
 } render_area;
 
 layout(binding = 1) uniform sampler2D texSampler;
+layout(set = 1, binding = 0) uniform sampler3D lut;
 
 layout(location = 0) out vec4 outColor;
 
+const float PI = 3.14159265358979;
+
+vec4 fetch(ivec2 texel) {
+	ivec2 size = textureSize(texSampler, 0);
+	return texelFetch(texSampler, clamp(texel, ivec2(0), size - 1), 0);
+}
+
+vec4 nearest(vec2 uv) {
+	return fetch(ivec2(floor(uv * textureSize(texSampler, 0))));
+}
+
+// Catmull-Rom weights for the texels at offsets -1, 0, 1, 2
+vec4 cubic_weights(float t) {
+	return vec4(
+		t * (-0.5 + t * (1.0 - 0.5 * t)),
+		1.0 + t * t * (-2.5 + 1.5 * t),
+		t * (0.5 + t * (2.0 - 1.5 * t)),
+		t * t * (-0.5 + 0.5 * t));
+}
+
+vec4 bicubic(vec2 uv) {
+	vec2 position = uv * textureSize(texSampler, 0) - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 t = position - floor(position);
+	vec4 wx = cubic_weights(t.x);
+	vec4 wy = cubic_weights(t.y);
+
+	vec4 result = vec4(0.0);
+	for (int j = 0; j < 4; j++) {
+		vec4 row = wx[0] * fetch(base + ivec2(-1, j - 1))
+			+ wx[1] * fetch(base + ivec2(0, j - 1))
+			+ wx[2] * fetch(base + ivec2(1, j - 1))
+			+ wx[3] * fetch(base + ivec2(2, j - 1));
+		result += wy[j] * row;
+	}
+	return result;
+}
+
+float lanczos3_weight(float x) {
+	if (abs(x) < 1e-5) {
+		return 1.0;
+	}
+	if (abs(x) >= 3.0) {
+		return 0.0;
+	}
+	float pi_x = PI * x;
+	return 3.0 * sin(pi_x) * sin(pi_x / 3.0) / (pi_x * pi_x);
+}
+
+vec4 lanczos3(vec2 uv) {
+	vec2 position = uv * textureSize(texSampler, 0) - 0.5;
+	ivec2 base = ivec2(floor(position));
+	vec2 t = position - floor(position);
+
+	float wx[6];
+	float wy[6];
+	float wx_sum = 0.0;
+	float wy_sum = 0.0;
+	for (int i = 0; i < 6; i++) {
+		wx[i] = lanczos3_weight(float(i - 2) - t.x);
+		wy[i] = lanczos3_weight(float(i - 2) - t.y);
+		wx_sum += wx[i];
+		wy_sum += wy[i];
+	}
+
+	vec4 result = vec4(0.0);
+	for (int j = 0; j < 6; j++) {
+		vec4 row = vec4(0.0);
+		for (int i = 0; i < 6; i++) {
+			row += wx[i] * fetch(base + ivec2(i - 2, j - 2));
+		}
+		result += wy[j] * row;
+	}
+	return result / (wx_sum * wy_sum);
+}
+
+float luma(vec4 color) {
+	return dot(color.rgb, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Bicubic in flat regions, on edges the result is blended with samples taken along the edge,
+// which removes the staircase artifacts of separable filters.
+vec4 edge_adaptive(vec2 uv) {
+	vec2 size = textureSize(texSampler, 0);
+	vec2 texel_size = 1.0 / size;
+	ivec2 center = ivec2(floor(uv * size));
+
+	float left = luma(fetch(center + ivec2(-1, 0)));
+	float right = luma(fetch(center + ivec2(1, 0)));
+	float top = luma(fetch(center + ivec2(0, -1)));
+	float bottom = luma(fetch(center + ivec2(0, 1)));
+	vec2 gradient = vec2(right - left, bottom - top);
+
+	vec4 cubic = bicubic(uv);
+	float edge_strength = length(gradient);
+	if (edge_strength < 0.05) {
+		return cubic;
+	}
+	vec2 tangent = vec2(-gradient.y, gradient.x) / edge_strength;
+	vec4 along_edge = 0.5 * texture(texSampler, uv + tangent * texel_size)
+		+ 0.5 * texture(texSampler, uv - tangent * texel_size);
+	float blend = smoothstep(0.05, 0.3, edge_strength) * 0.5;
+	return mix(cubic, along_edge, blend);
+}
+
+vec3 srgb_encode(vec3 linear) {
+	vec3 color = clamp(linear, 0.0, 1.0);
+	return mix(12.92 * color, 1.055 * pow(color, vec3(1.0 / 2.4)) - 0.055, step(0.0031308, color));
+}
+
+vec3 srgb_decode(vec3 encoded) {
+	vec3 color = clamp(encoded, 0.0, 1.0);
+	return mix(color / 12.92, pow((color + 0.055) / 1.055, vec3(2.4)), step(0.04045, color));
+}
+
+// position in the LUT in units of its entries
+vec3 lut_position(vec3 color) {
+	vec3 domain_min = vec3(render_area.lut_domain_min[0], render_area.lut_domain_min[1], render_area.lut_domain_min[2]);
+	vec3 domain_scale = vec3(render_area.lut_domain_scale[0], render_area.lut_domain_scale[1], render_area.lut_domain_scale[2]);
+	return clamp((color - domain_min) * domain_scale, 0.0, 1.0) * (render_area.lut_size - 1.0);
+}
+
+vec3 lut_trilinear(vec3 color) {
+	// centers of the first and the last texel are mapped to the domain boundaries
+	return texture(lut, (lut_position(color) + 0.5) / render_area.lut_size).rgb;
+}
+
+vec3 lut_entry(ivec3 position) {
+	return texelFetch(lut, position, 0).rgb;
+}
+
+// interpolation inside one of the six tetrahedra of the cube, selected by the order of the fractions
+vec3 lut_tetrahedral(vec3 color) {
+	vec3 position = lut_position(color);
+	ivec3 base = ivec3(min(floor(position), vec3(render_area.lut_size - 2.0)));
+	vec3 f = position - vec3(base);
+	vec3 c000 = lut_entry(base);
+	vec3 c111 = lut_entry(base + ivec3(1, 1, 1));
+	if (f.r > f.g) {
+		if (f.g > f.b) {
+			vec3 c100 = lut_entry(base + ivec3(1, 0, 0));
+			vec3 c110 = lut_entry(base + ivec3(1, 1, 0));
+			return c000 + f.r * (c100 - c000) + f.g * (c110 - c100) + f.b * (c111 - c110);
+		} else if (f.r > f.b) {
+			vec3 c100 = lut_entry(base + ivec3(1, 0, 0));
+			vec3 c101 = lut_entry(base + ivec3(1, 0, 1));
+			return c000 + f.r * (c100 - c000) + f.b * (c101 - c100) + f.g * (c111 - c101);
+		} else {
+			vec3 c001 = lut_entry(base + ivec3(0, 0, 1));
+			vec3 c101 = lut_entry(base + ivec3(1, 0, 1));
+			return c000 + f.b * (c001 - c000) + f.r * (c101 - c001) + f.g * (c111 - c101);
+		}
+	}
+	if (f.b > f.g) {
+		vec3 c001 = lut_entry(base + ivec3(0, 0, 1));
+		vec3 c011 = lut_entry(base + ivec3(0, 1, 1));
+		return c000 + f.b * (c001 - c000) + f.g * (c011 - c001) + f.r * (c111 - c011);
+	} else if (f.b > f.r) {
+		vec3 c010 = lut_entry(base + ivec3(0, 1, 0));
+		vec3 c011 = lut_entry(base + ivec3(0, 1, 1));
+		return c000 + f.g * (c010 - c000) + f.b * (c011 - c010) + f.r * (c111 - c011);
+	}
+	vec3 c010 = lut_entry(base + ivec3(0, 1, 0));
+	vec3 c110 = lut_entry(base + ivec3(1, 1, 0));
+	return c000 + f.g * (c010 - c000) + f.r * (c110 - c010) + f.b * (c111 - c110);
+}
+
 void main() {
 	float x = (gl_FragCoord.x - render_area.x) / render_area.width;
 	float y = (gl_FragCoord.y - render_area.y) / render_area.height;
-    outColor = texture(texSampler, vec2(x, y));
-}
\ No newline at end of file
+	vec3 position = vec3(x, y, 1.0);
+	vec2 uv = vec2(
+		dot(vec3(render_area.uv_transform_x[0], render_area.uv_transform_x[1], render_area.uv_transform_x[2]), position),
+		dot(vec3(render_area.uv_transform_y[0], render_area.uv_transform_y[1], render_area.uv_transform_y[2]), position));
+
+	if (scaling_filter == FILTER_NEAREST || scaling_filter == FILTER_INTEGER) {
+		outColor = nearest(uv);
+	} else if (scaling_filter == FILTER_BICUBIC) {
+		outColor = bicubic(uv);
+	} else if (scaling_filter == FILTER_LANCZOS3) {
+		outColor = lanczos3(uv);
+	} else if (scaling_filter == FILTER_EDGE_ADAPTIVE) {
+		outColor = edge_adaptive(uv);
+	} else {
+		outColor = texture(texSampler, uv);
+	}
+	if (render_area.lut_mode != LUT_DISABLED) {
+		vec3 color = render_area.lut_srgb == 1 ? srgb_encode(outColor.rgb) : outColor.rgb;
+		color = render_area.lut_mode == LUT_TETRAHEDRAL ? lut_tetrahedral(color) : lut_trilinear(color);
+		// the render target encodes the output again
+		outColor.rgb = render_area.lut_srgb == 1 ? srgb_decode(color) : color;
+	}
+	outColor.a *= render_area.alpha;
+}
@@ -0,0 +1,144 @@
+#include "bc1_encoder.h"
+
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct color {
+        int r, g, b;
+};
+
+uint16_t to_565(color c) {
+        return static_cast<uint16_t>(((c.r >> 3) << 11) | ((c.g >> 2) << 5) | (c.b >> 3));
+}
+
+color from_565(uint16_t value) {
+        int r = (value >> 11) & 31;
+        int g = (value >> 5) & 63;
+        int b = value & 31;
+        return { (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+}
+
+int distance(color a, color b) {
+        int r = a.r - b.r, g = a.g - b.g, b_ = a.b - b.b;
+        return r * r + g * g + b_ * b_;
+}
+
+void encode_block(const std::array<color, 16>& pixels, std::byte* block) {
+        color min{ 255, 255, 255 };
+        color max{ 0, 0, 0 };
+        color sum{ 0, 0, 0 };
+        for (auto& pixel : pixels) {
+                min = { std::min(min.r, pixel.r), std::min(min.g, pixel.g), std::min(min.b, pixel.b) };
+                max = { std::max(max.r, pixel.r), std::max(max.g, pixel.g), std::max(max.b, pixel.b) };
+                sum = { sum.r + pixel.r, sum.g + pixel.g, sum.b + pixel.b };
+        }
+
+        // bounding box diagonal is flipped for red and blue falling while green rises
+        int covariance_rg = 0, covariance_bg = 0;
+        for (auto& pixel : pixels) {
+                int g = pixel.g * 16 - sum.g;
+                covariance_rg += (pixel.r * 16 - sum.r) * g;
+                covariance_bg += (pixel.b * 16 - sum.b) * g;
+        }
+        if (covariance_rg < 0) {
+                std::swap(min.r, max.r);
+        }
+        if (covariance_bg < 0) {
+                std::swap(min.b, max.b);
+        }
+
+        // endpoints are moved inside the box by 1/16 of its size, which lowers the error of the outliers
+        auto inset = [](int& low, int& high) {
+                int offset = (high - low) / 16;
+                low = std::clamp(low + offset, 0, 255);
+                high = std::clamp(high - offset, 0, 255);
+        };
+        inset(min.r, max.r);
+        inset(min.g, max.g);
+        inset(min.b, max.b);
+
+        uint16_t endpoint0 = to_565(max);
+        uint16_t endpoint1 = to_565(min);
+        // four color mode requires the first endpoint to be greater
+        if (endpoint0 < endpoint1) {
+                std::swap(endpoint0, endpoint1);
+        }
+
+        uint32_t indices = 0;
+        if (endpoint0 != endpoint1) {
+                color c0 = from_565(endpoint0);
+                color c1 = from_565(endpoint1);
+                std::array<color, 4> palette{ c0, c1,
+                        color{ (2 * c0.r + c1.r) / 3, (2 * c0.g + c1.g) / 3, (2 * c0.b + c1.b) / 3 },
+                        color{ (c0.r + 2 * c1.r) / 3, (c0.g + 2 * c1.g) / 3, (c0.b + 2 * c1.b) / 3 } };
+                for (uint32_t i = 0; i < 16; i++) {
+                        uint32_t best = 0;
+                        int best_distance = distance(pixels[i], palette[0]);
+                        for (uint32_t j = 1; j < 4; j++) {
+                                int d = distance(pixels[i], palette[j]);
+                                if (d < best_distance) {
+                                        best = j;
+                                        best_distance = d;
+                                }
+                        }
+                        indices |= best << (2 * i);
+                }
+        }
+
+        std::array<uint8_t, 8> bytes{
+                static_cast<uint8_t>(endpoint0), static_cast<uint8_t>(endpoint0 >> 8),
+                static_cast<uint8_t>(endpoint1), static_cast<uint8_t>(endpoint1 >> 8),
+                static_cast<uint8_t>(indices), static_cast<uint8_t>(indices >> 8),
+                static_cast<uint8_t>(indices >> 16), static_cast<uint8_t>(indices >> 24) };
+        std::copy(bytes.begin(), bytes.end(), reinterpret_cast<uint8_t*>(block));
+}
+
+void encode_block_rows(const std::byte* pixels, size_t pixel_row_pitch, uint32_t width, uint32_t height,
+        std::byte* blocks, size_t block_row_pitch, uint32_t first_row, uint32_t last_row)
+{
+        uint32_t block_columns = (width + 3) / 4;
+        std::array<color, 16> block_pixels{};
+        for (uint32_t block_row = first_row; block_row < last_row; block_row++) {
+                for (uint32_t block_column = 0; block_column < block_columns; block_column++) {
+                        for (uint32_t i = 0; i < 16; i++) {
+                                uint32_t x = std::min(block_column * 4 + i % 4, width - 1);
+                                uint32_t y = std::min(block_row * 4 + i / 4, height - 1);
+                                auto* pixel = reinterpret_cast<const uint8_t*>(pixels + y * pixel_row_pitch + x * 4);
+                                block_pixels[i] = { pixel[0], pixel[1], pixel[2] };
+                        }
+                        encode_block(block_pixels, blocks + block_row * block_row_pitch + block_column * 8);
+                }
+        }
+}
+
+} //namespace -------------------------------------------------------------
+
+namespace vulkan_display {
+
+void encode_bc1(const std::byte* pixels, size_t pixel_row_pitch, uint32_t width, uint32_t height,
+        std::byte* blocks, size_t block_row_pitch, uint32_t thread_count)
+{
+        if (width == 0 || height == 0) {
+                return;
+        }
+        uint32_t block_rows = (height + 3) / 4;
+        thread_count = std::clamp(thread_count, 1u, block_rows);
+        auto part_begin = [=](uint32_t part) { return block_rows * part / thread_count; };
+
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count - 1);
+        for (uint32_t part = 1; part < thread_count; part++) {
+                threads.emplace_back(encode_block_rows, pixels, pixel_row_pitch, width, height,
+                        blocks, block_row_pitch, part_begin(part), part_begin(part + 1));
+        }
+        encode_block_rows(pixels, pixel_row_pitch, width, height, blocks, block_row_pitch, 0, part_begin(1));
+        for (auto& thread : threads) {
+                thread.join();
+        }
+}
+
+} // vulkan_display
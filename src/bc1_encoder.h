@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vulkan_display {
+
+/**
+ * Fast BC1 encoder for producers trading cpu time for upload bandwidth, endpoints are taken from the bounding box
+ * of the block colors. Source pixels are RGBA8 (or BGRA8 for BGRA destination formats), alpha is ignored.
+ * Rows of blocks are split among thread_count threads, the calling thread encodes the first part.
+ * Size doesn't have to be a multiple of 4, edge pixels are repeated.
+ */
+void encode_bc1(const std::byte* pixels, size_t pixel_row_pitch, uint32_t width, uint32_t height,
+        std::byte* blocks, size_t block_row_pitch, uint32_t thread_count = 1);
+
+} // vulkan_display
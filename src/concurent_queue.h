@@ -1,5 +1,6 @@
 #pragma once
 
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <optional>
@@ -66,6 +67,23 @@ public:
                 return result;
         }
         
+        /// returns nothing if the queue stays empty until the deadline
+        template<typename Clock, typename Duration>
+        std::optional<T> pop_until(const std::chrono::time_point<Clock, Duration>& deadline) {
+                std::unique_lock lock{ mutex };
+                if (!queue_non_empty.wait_until(lock, deadline, [&d = this->deque]() { return !d.empty(); })) {
+                        return {};
+                }
+                T result = std::move(deque.front());
+                deque.pop_front();
+                return result;
+        }
+
+        template<typename Rep, typename Period>
+        std::optional<T> try_pop_for(const std::chrono::duration<Rep, Period>& timeout) {
+                return pop_until(std::chrono::steady_clock::now() + timeout);
+        }
+
         std::optional<T> try_pop() {
                 std::scoped_lock lock{ mutex };
                 if (deque.empty()) {
@@ -0,0 +1,422 @@
+#include "frame_playback.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std::literals;
+using namespace vulkan_display_detail;
+
+namespace {
+
+constexpr char raw_file_magic[8] = { 'V', 'F', 'R', 'R', 'A', 'W', '0', '1' };
+constexpr auto y4m_file_magic = "YUV4MPEG2 "sv;
+constexpr auto y4m_frame_magic = "FRAME"sv;
+
+size_t get_page_size() {
+#ifdef _WIN32
+        SYSTEM_INFO info{};
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+/// asks the os to read the range of the mapping and touches its pages, so they are resident when the frame is copied
+void prefetch_range(const std::byte* begin, size_t size, size_t page_size) {
+        auto first_page = reinterpret_cast<uintptr_t>(begin) / page_size * page_size;
+        auto* aligned = reinterpret_cast<const std::byte*>(first_page);
+        size += static_cast<size_t>(begin - aligned);
+#ifdef _WIN32
+        WIN32_MEMORY_RANGE_ENTRY range{ const_cast<std::byte*>(aligned), size };
+        PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+        madvise(const_cast<std::byte*>(aligned), size, MADV_WILLNEED);
+#endif
+        uint8_t sum = 0;
+        for (size_t offset = 0; offset < size; offset += page_size) {
+                sum += *reinterpret_cast<const volatile uint8_t*>(aligned + offset);
+        }
+        (void)sum;
+}
+
+/// drops the pages of the range from the resident memory, pages shared with neighbouring frames are kept
+void release_range(const std::byte* begin, size_t size, size_t page_size) {
+        auto first_page = (reinterpret_cast<uintptr_t>(begin) + page_size - 1) / page_size * page_size;
+        auto end_page = (reinterpret_cast<uintptr_t>(begin) + size) / page_size * page_size;
+        if (end_page <= first_page) {
+                return;
+        }
+        auto* aligned = reinterpret_cast<std::byte*>(first_page);
+#ifdef _WIN32
+        // unlocking pages which aren't locked removes them from the working set
+        VirtualUnlock(aligned, end_page - first_page);
+#else
+        madvise(aligned, end_page - first_page, MADV_DONTNEED);
+#endif
+}
+
+uint8_t clamp_to_byte(int value) {
+        return static_cast<uint8_t>(std::clamp(value, 0, 255));
+}
+
+/// BT.601 limited range
+void write_rgba(uint8_t* pixel, int y, int u, int v) {
+        int c = 298 * (y - 16) + 128;
+        int d = u - 128;
+        int e = v - 128;
+        pixel[0] = clamp_to_byte((c + 409 * e) >> 8);
+        pixel[1] = clamp_to_byte((c - 100 * d - 208 * e) >> 8);
+        pixel[2] = clamp_to_byte((c + 516 * d) >> 8);
+        pixel[3] = 255;
+}
+
+bool parse_number(std::string_view text, uint32_t& number) {
+        if (text.empty()) {
+                return false;
+        }
+        uint64_t value = 0;
+        for (char c : text) {
+                if (c < '0' || c > '9' || value > UINT32_MAX) {
+                        return false;
+                }
+                value = value * 10 + static_cast<uint64_t>(c - '0');
+        }
+        number = static_cast<uint32_t>(value);
+        return value <= UINT32_MAX;
+}
+
+} //namespace -------------------------------------------------------------
+
+namespace vulkan_display {
+
+RETURN_TYPE frame_playback::map_file(const std::filesystem::path& path) {
+#ifdef _WIN32
+        HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        CHECK(file != INVALID_HANDLE_VALUE, "Failed to open file:"s + path.string());
+        file_handle = file;
+        LARGE_INTEGER size{};
+        CHECK(GetFileSizeEx(file, &size) && size.QuadPart > 0, "Failed to get size of file:"s + path.string());
+        file_size = static_cast<size_t>(size.QuadPart);
+        mapping_handle = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CHECK(mapping_handle != nullptr, "Failed to map file:"s + path.string());
+        data = static_cast<const std::byte*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        CHECK(data != nullptr, "Failed to map file:"s + path.string());
+#else
+        file_descriptor = ::open(path.c_str(), O_RDONLY);
+        CHECK(file_descriptor >= 0, "Failed to open file:"s + path.string());
+        struct stat status{};
+        CHECK(fstat(file_descriptor, &status) == 0 && status.st_size > 0, "Failed to get size of file:"s + path.string());
+        file_size = static_cast<size_t>(status.st_size);
+        void* mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        CHECK(mapping != MAP_FAILED, "Failed to map file:"s + path.string());
+        data = static_cast<const std::byte*>(mapping);
+        // the read-ahead thread prefetches frames itself, the default read-ahead of the kernel would only double it
+        madvise(mapping, file_size, MADV_RANDOM);
+#endif
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE frame_playback::parse_raw_header() {
+        CHECK(file_size >= sizeof(raw_file_header), "Raw file is shorter than its header.");
+        raw_file_header header{};
+        std::memcpy(&header, data, sizeof(header));
+        CHECK(std::memcmp(header.magic, raw_file_magic, sizeof(raw_file_magic)) == 0, "Unknown frame file format.");
+        CHECK(header.width > 0 && header.height > 0, "Raw file has an empty frame size.");
+        CHECK(header.frame_rate_numerator > 0 && header.frame_rate_denominator > 0, "Raw file has an invalid frame rate.");
+
+        type = file_type::raw;
+        description = image_description{ header.width, header.height, static_cast<vk::Format>(header.format) };
+        auto block_size = get_compressed_block_size(description.format);
+        auto pixel_size = get_pixel_size(description.format);
+        CHECK(block_size != 0 || pixel_size != 0, "Raw file has an unsupported format.");
+        if (block_size != 0) {
+                constexpr auto extent = compressed_block_extent;
+                frame_data_size = static_cast<size_t>(block_size * ((header.width + extent - 1) / extent)
+                        * ((header.height + extent - 1) / extent));
+        } else {
+                frame_data_size = static_cast<size_t>(pixel_size * header.width * header.height);
+        }
+        first_frame_offset = sizeof(raw_file_header);
+        frame_header_size = 0;
+        frame_count = (file_size - first_frame_offset) / frame_data_size;
+        frame_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+                static_cast<double>(header.frame_rate_denominator) / header.frame_rate_numerator));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE frame_playback::parse_y4m_header() {
+        std::string_view file{ reinterpret_cast<const char*>(data), file_size };
+        auto header_end = file.find('\n');
+        CHECK(header_end != std::string_view::npos, "Y4M file has no complete header.");
+        auto header = file.substr(y4m_file_magic.size(), header_end - y4m_file_magic.size());
+
+        uint32_t width = 0, height = 0;
+        uint32_t rate_numerator = 0, rate_denominator = 0;
+        std::string_view colorspace = "420jpeg";
+        while (!header.empty()) {
+                auto token_end = std::min(header.find(' '), header.size());
+                auto token = header.substr(0, token_end);
+                header.remove_prefix(std::min(token_end + 1, header.size()));
+                if (token.empty()) {
+                        continue;
+                }
+                auto value = token.substr(1);
+                switch (token[0]) {
+                case 'W':
+                        CHECK(parse_number(value, width), "Y4M file has an invalid width.");
+                        break;
+                case 'H':
+                        CHECK(parse_number(value, height), "Y4M file has an invalid height.");
+                        break;
+                case 'F': {
+                        auto colon = value.find(':');
+                        CHECK(colon != std::string_view::npos
+                                && parse_number(value.substr(0, colon), rate_numerator)
+                                && parse_number(value.substr(colon + 1), rate_denominator),
+                                "Y4M file has an invalid frame rate.");
+                        break;
+                }
+                case 'C':
+                        colorspace = value;
+                        break;
+                default:
+                        break;
+                }
+        }
+        CHECK(width > 0 && height > 0, "Y4M file has an empty frame size.");
+        CHECK(rate_numerator > 0 && rate_denominator > 0, "Y4M file has an invalid frame rate.");
+
+        size_t luma_size = static_cast<size_t>(width) * height;
+        if (colorspace == "420jpeg" || colorspace == "420paldv" || colorspace == "420mpeg2" || colorspace == "420") {
+                type = file_type::y4m_420;
+                frame_data_size = luma_size + 2 * (static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2));
+        } else if (colorspace == "444") {
+                type = file_type::y4m_444;
+                frame_data_size = 3 * luma_size;
+        } else if (colorspace == "mono") {
+                type = file_type::y4m_mono;
+                frame_data_size = luma_size;
+        } else {
+                CHECK(false, "Y4M file has an unsupported colorspace:"s + std::string(colorspace));
+        }
+
+        // frame headers may carry parameters, but all frames are expected to use the header of the first one
+        first_frame_offset = header_end + 1;
+        auto frame_header_end = file.find('\n', first_frame_offset);
+        CHECK(frame_header_end != std::string_view::npos
+                && file.substr(first_frame_offset, y4m_frame_magic.size()) == y4m_frame_magic,
+                "Y4M file has no frames.");
+        frame_header_size = frame_header_end + 1 - first_frame_offset;
+        frame_count = (file_size - first_frame_offset) / (frame_header_size + frame_data_size);
+
+        description = image_description{ width, height, vk::Format::eR8G8B8A8Srgb };
+        frame_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(
+                static_cast<double>(rate_denominator) / rate_numerator));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE frame_playback::open(const std::filesystem::path& path, uint32_t read_ahead_frames) {
+        close();
+        PASS_RESULT(map_file(path));
+        if (file_size >= y4m_file_magic.size()
+                && std::memcmp(data, y4m_file_magic.data(), y4m_file_magic.size()) == 0)
+        {
+                PASS_RESULT(parse_y4m_header());
+        } else {
+                PASS_RESULT(parse_raw_header());
+        }
+        CHECK(frame_count > 0, "Frame file contains no complete frame:"s + path.string());
+
+        this->read_ahead_frames = std::max(read_ahead_frames, 1u);
+        position = 0;
+        stop_read_ahead = false;
+        read_ahead_thread = std::thread(&frame_playback::read_ahead, this);
+        return RETURN_TYPE();
+}
+
+void frame_playback::close() {
+        if (read_ahead_thread.joinable()) {
+                {
+                        std::scoped_lock lock(position_mutex);
+                        stop_read_ahead = true;
+                }
+                position_changed.notify_one();
+                read_ahead_thread.join();
+        }
+#ifdef _WIN32
+        if (data) {
+                UnmapViewOfFile(data);
+        }
+        if (mapping_handle) {
+                CloseHandle(mapping_handle);
+                mapping_handle = nullptr;
+        }
+        if (file_handle) {
+                CloseHandle(file_handle);
+                file_handle = nullptr;
+        }
+#else
+        if (data) {
+                munmap(const_cast<std::byte*>(data), file_size);
+        }
+        if (file_descriptor >= 0) {
+                ::close(file_descriptor);
+                file_descriptor = -1;
+        }
+#endif
+        data = nullptr;
+        file_size = 0;
+        frame_count = 0;
+}
+
+void frame_playback::read_ahead() {
+        const size_t page_size = get_page_size();
+        const uint64_t window = std::min<uint64_t>(read_ahead_frames, frame_count);
+        auto frame_range = [&](uint64_t frame_index) {
+                return std::pair{ get_frame_data(frame_index) - frame_header_size, frame_header_size + frame_data_size };
+        };
+        // window wraps around the end of the file, so looped playback is prefetched too
+        auto in_window = [&](uint64_t frame_index, uint64_t window_start) {
+                return (frame_index + frame_count - window_start) % frame_count < window;
+        };
+
+        bool has_window = false;
+        uint64_t window_start = 0;
+        std::unique_lock lock(position_mutex);
+        while (!stop_read_ahead) {
+                uint64_t current = position;
+                lock.unlock();
+
+                // frames leaving the window were played already or skipped by a seek
+                if (has_window) {
+                        for (uint64_t i = 0; i < window; i++) {
+                                uint64_t frame_index = (window_start + i) % frame_count;
+                                if (!in_window(frame_index, current)) {
+                                        auto [begin, size] = frame_range(frame_index);
+                                        release_range(begin, size, page_size);
+                                }
+                        }
+                }
+                for (uint64_t i = 0; i < window; i++) {
+                        uint64_t frame_index = (current + i) % frame_count;
+                        if (!has_window || !in_window(frame_index, window_start)) {
+                                auto [begin, size] = frame_range(frame_index);
+                                prefetch_range(begin, size, page_size);
+                        }
+                }
+                has_window = true;
+                window_start = current;
+
+                lock.lock();
+                position_changed.wait(lock, [&] { return stop_read_ahead || position != current; });
+        }
+}
+
+void frame_playback::copy_frame(uint64_t frame_index, image& image) const {
+        const std::byte* source = get_frame_data(frame_index);
+        std::byte* destination = image.get_memory_ptr();
+        auto row_pitch = static_cast<size_t>(image.get_row_pitch());
+        uint32_t width = description.size.width;
+        uint32_t height = description.size.height;
+
+        if (type == file_type::raw) {
+                auto rows = get_compressed_block_size(description.format) != 0 ?
+                        (height + compressed_block_extent - 1) / compressed_block_extent :
+                        height;
+                size_t row_size = frame_data_size / rows;
+                if (row_size == row_pitch) {
+                        std::memcpy(destination, source, frame_data_size);
+                        return;
+                }
+                for (uint32_t row = 0; row < rows; row++) {
+                        std::memcpy(destination + row * row_pitch, source + row * row_size, row_size);
+                }
+                return;
+        }
+
+        auto* luma = reinterpret_cast<const uint8_t*>(source);
+        size_t luma_size = static_cast<size_t>(width) * height;
+        for (uint32_t y = 0; y < height; y++) {
+                auto* pixel = reinterpret_cast<uint8_t*>(destination + y * row_pitch);
+                const uint8_t* luma_row = luma + static_cast<size_t>(y) * width;
+                if (type == file_type::y4m_mono) {
+                        for (uint32_t x = 0; x < width; x++, pixel += 4) {
+                                write_rgba(pixel, luma_row[x], 128, 128);
+                        }
+                } else if (type == file_type::y4m_444) {
+                        const uint8_t* u_row = luma_row + luma_size;
+                        const uint8_t* v_row = u_row + luma_size;
+                        for (uint32_t x = 0; x < width; x++, pixel += 4) {
+                                write_rgba(pixel, luma_row[x], u_row[x], v_row[x]);
+                        }
+                } else {
+                        size_t chroma_width = (width + 1) / 2;
+                        size_t chroma_size = chroma_width * ((height + 1) / 2);
+                        const uint8_t* u_row = luma + luma_size + (y / 2) * chroma_width;
+                        const uint8_t* v_row = u_row + chroma_size;
+                        for (uint32_t x = 0; x < width; x++, pixel += 4) {
+                                write_rgba(pixel, luma_row[x], u_row[x / 2], v_row[x / 2]);
+                        }
+                }
+        }
+}
+
+RETURN_TYPE frame_playback::queue_frame(vulkan_display& display, uint64_t frame_index) {
+        CHECK(is_open() && frame_index < frame_count, "Frame index is out of range.");
+        if (frame_header_size != 0) {
+                auto* frame_header = reinterpret_cast<const char*>(get_frame_data(frame_index) - frame_header_size);
+                CHECK(std::string_view(frame_header, y4m_frame_magic.size()) == y4m_frame_magic,
+                        "Y4M frame headers have different lengths.");
+        }
+        {
+                std::scoped_lock lock(position_mutex);
+                position = frame_index;
+        }
+        position_changed.notify_one();
+
+        image image;
+        PASS_RESULT(display.acquire_image(image, description));
+        copy_frame(frame_index, image);
+        PASS_RESULT(display.queue_image(image));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE frame_playback::play(vulkan_display& display, const std::atomic<bool>& stop, bool loop) {
+        using clock = std::chrono::steady_clock;
+        auto next_frame_time = clock::now();
+        for (uint64_t frame_index = 0; !stop; ) {
+                PASS_RESULT(queue_frame(display, frame_index));
+                next_frame_time += frame_duration;
+                auto now = clock::now();
+                // a late producer doesn't catch up with a burst of frames
+                if (now - next_frame_time > frame_duration) {
+                        next_frame_time = now;
+                }
+                std::this_thread::sleep_until(next_frame_time);
+                if (++frame_index == frame_count) {
+                        if (!loop) {
+                                break;
+                        }
+                        frame_index = 0;
+                }
+        }
+        return RETURN_TYPE();
+}
+
+} // vulkan_display
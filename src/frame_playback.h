@@ -0,0 +1,112 @@
+#pragma once
+
+#include "vulkan_display.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+namespace vulkan_display {
+
+/**
+ * Plays frame files mapped into memory, every frame is copied from the mapping directly into an acquired image.
+ * Supported files are Y4M with 8 bit 4:2:0, 4:4:4 or mono frames, which are converted to RGBA while copying,
+ * and raw files made of raw_file_header followed by tightly packed frames of any format supported by the display.
+ * Read-ahead thread prefetches the following frames and releases the played ones, so resident memory stays bounded.
+ */
+class frame_playback {
+public:
+        struct raw_file_header {
+                char magic[8];                  ///< "VFRRAW01"
+                uint32_t width;
+                uint32_t height;
+                uint32_t format;                ///< VkFormat of the frames
+                uint32_t frame_rate_numerator;
+                uint32_t frame_rate_denominator;
+                uint32_t reserved;
+        };
+        static_assert(sizeof(raw_file_header) == 32);
+
+private:
+        enum class file_type { raw, y4m_420, y4m_444, y4m_mono };
+
+        const std::byte* data = nullptr;
+        size_t file_size = 0;
+#ifdef _WIN32
+        void* file_handle = nullptr;
+        void* mapping_handle = nullptr;
+#else
+        int file_descriptor = -1;
+#endif
+
+        file_type type = file_type::raw;
+        image_description description{};
+        size_t first_frame_offset = 0;
+        size_t frame_header_size = 0;   // "FRAME\n" of Y4M frames
+        size_t frame_data_size = 0;
+        uint64_t frame_count = 0;
+        std::chrono::steady_clock::duration frame_duration{};
+
+        uint32_t read_ahead_frames = 0;
+        std::thread read_ahead_thread{};
+        std::mutex position_mutex{};
+        std::condition_variable position_changed{};
+        uint64_t position = 0;          // frame which is being copied
+        bool stop_read_ahead = false;
+
+        RETURN_TYPE map_file(const std::filesystem::path& path);
+
+        RETURN_TYPE parse_raw_header();
+
+        RETURN_TYPE parse_y4m_header();
+
+        const std::byte* get_frame_data(uint64_t frame_index) const {
+                return data + first_frame_offset + frame_index * (frame_header_size + frame_data_size) + frame_header_size;
+        }
+
+        void read_ahead();
+
+        void copy_frame(uint64_t frame_index, image& image) const;
+
+public:
+        frame_playback() = default;
+        frame_playback(const frame_playback& other) = delete;
+        frame_playback& operator=(const frame_playback& other) = delete;
+
+        ~frame_playback() {
+                close();
+        }
+
+        /// read_ahead_frames is the number of frames prefetched in front of the played one
+        RETURN_TYPE open(const std::filesystem::path& path, uint32_t read_ahead_frames = 8);
+
+        void close();
+
+        bool is_open() const {
+                return data != nullptr;
+        }
+
+        uint64_t get_frame_count() const {
+                return frame_count;
+        }
+
+        std::chrono::steady_clock::duration get_frame_duration() const {
+                return frame_duration;
+        }
+
+        image_description get_description() const {
+                return description;
+        }
+
+        /// acquires an image from the display, copies the frame into it and queues it
+        RETURN_TYPE queue_frame(vulkan_display& display, uint64_t frame_index);
+
+        /// queues frames at the native rate of the file until stop is set or the last frame is queued without loop
+        RETURN_TYPE play(vulkan_display& display, const std::atomic<bool>& stop, bool loop = true);
+};
+
+} // vulkan_display
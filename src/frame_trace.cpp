@@ -0,0 +1,121 @@
+#include "frame_trace.h"
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+using namespace std::literals;
+
+namespace {
+
+using namespace vulkan_display_detail;
+
+struct trace_registry {
+        std::mutex mutex;
+        std::vector<std::shared_ptr<trace_buffer>> buffers;
+        std::atomic<uint64_t> generation = 0;
+        std::atomic<int64_t> start_ns = 0;
+        std::atomic<uint32_t> next_thread_id = 1;
+};
+
+trace_registry registry;
+
+thread_local std::shared_ptr<trace_buffer> thread_buffer;
+thread_local uint64_t thread_generation = 0;
+thread_local uint32_t thread_id = 0;
+
+int64_t steady_clock_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// chrome expects microseconds, nanoseconds are kept as the fraction
+void write_microseconds(std::ostream& stream, uint64_t ns) {
+        auto fraction = ns % 1000;
+        stream << ns / 1000 << '.' << (fraction < 100 ? "0" : "") << (fraction < 10 ? "0" : "") << fraction;
+}
+
+} //namespace -------------------------------------------------------------
+
+namespace vulkan_display_detail {
+
+uint64_t frame_tracer::now_ns() {
+        return static_cast<uint64_t>(steady_clock_ns() - registry.start_ns.load(std::memory_order_relaxed));
+}
+
+void frame_tracer::record(const trace_event& event) {
+        auto generation = registry.generation.load(std::memory_order_acquire);
+        if (thread_generation != generation) {
+                // the first event of the thread in this trace, later events don't lock
+                if (thread_id == 0) {
+                        thread_id = registry.next_thread_id.fetch_add(1);
+                }
+                auto buffer = std::make_shared<trace_buffer>();
+                buffer->thread_id = thread_id;
+                std::scoped_lock lock(registry.mutex);
+                if (!tracing_enabled) {
+                        return;
+                }
+                registry.buffers.push_back(buffer);
+                thread_buffer = std::move(buffer);
+                thread_generation = registry.generation.load(std::memory_order_relaxed);
+        }
+        thread_buffer->push(event);
+}
+
+void frame_tracer::start() {
+        std::scoped_lock lock(registry.mutex);
+        registry.buffers.clear();
+        registry.start_ns = steady_clock_ns();
+        registry.generation++;
+        tracing_enabled = true;
+}
+
+RETURN_TYPE frame_tracer::stop(const std::filesystem::path& path) {
+        std::vector<std::shared_ptr<trace_buffer>> buffers;
+        {
+                std::scoped_lock lock(registry.mutex);
+                tracing_enabled = false;
+                buffers = registry.buffers;
+        }
+
+        std::ofstream file(path);
+        CHECK(file.is_open(), "Failed to open file:"s + path.string());
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        bool first = true;
+        uint64_t lost_count = 0;
+        for (auto& buffer : buffers) {
+                // threads may still finish events started before the stop, the published ones are complete
+                size_t count = buffer->count.load(std::memory_order_acquire);
+                lost_count += buffer->lost_count.load(std::memory_order_relaxed);
+                for (size_t i = 0; i < count; i++) {
+                        auto& event = buffer->events[i];
+                        file << (first ? "" : ",\n") << "{\"name\":\"" << event.name
+                                << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->thread_id << ",\"ts\":";
+                        write_microseconds(file, event.start_ns);
+                        file << ",\"dur\":";
+                        write_microseconds(file, event.duration_ns);
+                        file << ",\"args\":{";
+                        const char* separator = "";
+                        if (event.frame_number != 0) {
+                                file << "\"frame\":" << event.frame_number;
+                                separator = ",";
+                        }
+                        if (event.image_id != UINT32_MAX) {
+                                file << separator << "\"image\":" << event.image_id;
+                                separator = ",";
+                        }
+                        if (event.argument_name) {
+                                file << separator << "\"" << event.argument_name << "\":" << event.argument;
+                        }
+                        file << "}}";
+                        first = false;
+                }
+        }
+        file << "\n],\"otherData\":{\"lost_events\":" << lost_count << "}}\n";
+        CHECK(file.good(), "Error writing to file:"s + path.string());
+        return RETURN_TYPE();
+}
+
+} // vulkan_display_detail
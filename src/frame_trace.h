@@ -0,0 +1,102 @@
+#pragma once
+
+#include "vulkan_context.h"
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+namespace vulkan_display_detail {
+
+struct trace_event {
+        const char* name = nullptr;             ///< string literal, events only store the pointer
+        uint64_t start_ns = 0;                  ///< since the start of the trace
+        uint64_t duration_ns = 0;
+        uint64_t frame_number = 0;              ///< 0 if the event doesn't belong to a frame
+        uint32_t image_id = UINT32_MAX;         ///< transfer image, UINT32_MAX if none
+        const char* argument_name = nullptr;
+        uint64_t argument = 0;
+};
+
+/// events of one thread, only the owning thread writes and events below count are never modified again
+class trace_buffer {
+public:
+        static constexpr size_t capacity = size_t{ 1 } << 16;
+
+        uint32_t thread_id = 0;
+        std::unique_ptr<trace_event[]> events{ new trace_event[capacity] };
+        std::atomic<size_t> count = 0;
+        std::atomic<uint64_t> lost_count = 0;
+
+        void push(const trace_event& event) {
+                size_t index = count.load(std::memory_order_relaxed);
+                if (index == capacity) {
+                        lost_count.fetch_add(1, std::memory_order_relaxed);
+                        return;
+                }
+                events[index] = event;
+                count.store(index + 1, std::memory_order_release);
+        }
+};
+
+/// checked by every trace point, disabled tracing costs one relaxed load
+inline std::atomic<bool> tracing_enabled = false;
+
+/**
+ * Process wide tracer, every thread records into its own buffer which is registered on the first event of a trace.
+ * The trace is written as Chrome trace-event JSON, it can be opened in chrome://tracing or Perfetto.
+ */
+class frame_tracer {
+public:
+        static uint64_t now_ns();
+
+        static void record(const trace_event& event);
+
+        /// events of the previous trace are dropped
+        static void start();
+
+        static RETURN_TYPE stop(const std::filesystem::path& path);
+};
+
+/// records the lifetime of the scope as one event if tracing is enabled
+class trace_scope {
+        trace_event event{};
+        bool active = false;
+public:
+        explicit trace_scope(const char* name, uint64_t frame_number = 0, uint32_t image_id = UINT32_MAX) :
+                active{ tracing_enabled.load(std::memory_order_relaxed) }
+        {
+                if (active) {
+                        event.name = name;
+                        event.frame_number = frame_number;
+                        event.image_id = image_id;
+                        event.start_ns = frame_tracer::now_ns();
+                }
+        }
+
+        trace_scope(const trace_scope& other) = delete;
+        trace_scope& operator=(const trace_scope& other) = delete;
+
+        ~trace_scope() {
+                if (active) {
+                        event.duration_ns = frame_tracer::now_ns() - event.start_ns;
+                        frame_tracer::record(event);
+                }
+        }
+
+        void set_frame_number(uint64_t frame_number) {
+                event.frame_number = frame_number;
+        }
+
+        void set_image_id(uint32_t image_id) {
+                event.image_id = image_id;
+        }
+
+        void set_argument(const char* name, uint64_t value) {
+                event.argument_name = name;
+                event.argument = value;
+        }
+};
+
+} // vulkan_display_detail
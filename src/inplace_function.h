@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * Replacement of std::function which never allocates, the callable is stored in the buffer of size capacity.
+ * Callables which don't fit are rejected at compile time.
+ */
+template<typename Signature, size_t capacity = 48>
+class inplace_function;
+
+template<typename R, typename... Args, size_t capacity>
+class inplace_function<R(Args...), capacity> {
+        enum class operation { copy, move, destroy };
+
+        using invoke_function = R(*)(void* callable, Args&&... args);
+        using manage_function = void(*)(operation op, void* destination, void* source);
+
+        alignas(std::max_align_t) std::byte storage[capacity];
+        invoke_function invoke_ptr = nullptr;
+        manage_function manage_ptr = nullptr;
+
+        template<typename F>
+        static R invoke(void* callable, Args&&... args) {
+                return (*static_cast<F*>(callable))(std::forward<Args>(args)...);
+        }
+
+        template<typename F>
+        static void manage(operation op, void* destination, void* source) {
+                switch (op) {
+                case operation::copy:
+                        new (destination) F(*static_cast<const F*>(source));
+                        break;
+                case operation::move:
+                        new (destination) F(std::move(*static_cast<F*>(source)));
+                        break;
+                case operation::destroy:
+                        static_cast<F*>(destination)->~F();
+                        break;
+                }
+        }
+
+        void copy_from(const inplace_function& other) {
+                if (other.manage_ptr) {
+                        other.manage_ptr(operation::copy, storage, const_cast<std::byte*>(other.storage));
+                }
+                invoke_ptr = other.invoke_ptr;
+                manage_ptr = other.manage_ptr;
+        }
+
+        void move_from(inplace_function& other) noexcept {
+                if (other.manage_ptr) {
+                        other.manage_ptr(operation::move, storage, other.storage);
+                }
+                invoke_ptr = other.invoke_ptr;
+                manage_ptr = other.manage_ptr;
+                other.reset();
+        }
+
+public:
+        inplace_function() = default;
+
+        inplace_function(std::nullptr_t) { }
+
+        template<typename F, typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<F>, inplace_function> && std::is_invocable_r_v<R, std::decay_t<F>&, Args...>>>
+        inplace_function(F&& function) {
+                using callable = std::decay_t<F>;
+                static_assert(sizeof(callable) <= capacity, "Callable is too large for the inplace_function.");
+                static_assert(alignof(callable) <= alignof(std::max_align_t), "Callable is overaligned.");
+                static_assert(std::is_nothrow_move_constructible_v<callable>, "Callable has to be nothrow movable.");
+                new (storage) callable(std::forward<F>(function));
+                invoke_ptr = &invoke<callable>;
+                manage_ptr = &manage<callable>;
+        }
+
+        inplace_function(const inplace_function& other) {
+                copy_from(other);
+        }
+
+        inplace_function(inplace_function&& other) noexcept {
+                move_from(other);
+        }
+
+        inplace_function& operator=(const inplace_function& other) {
+                if (this != &other) {
+                        reset();
+                        copy_from(other);
+                }
+                return *this;
+        }
+
+        inplace_function& operator=(inplace_function&& other) noexcept {
+                if (this != &other) {
+                        reset();
+                        move_from(other);
+                }
+                return *this;
+        }
+
+        inplace_function& operator=(std::nullptr_t) noexcept {
+                reset();
+                return *this;
+        }
+
+        ~inplace_function() {
+                reset();
+        }
+
+        void reset() noexcept {
+                if (manage_ptr) {
+                        manage_ptr(operation::destroy, storage, nullptr);
+                }
+                invoke_ptr = nullptr;
+                manage_ptr = nullptr;
+        }
+
+        explicit operator bool() const noexcept {
+                return invoke_ptr != nullptr;
+        }
+
+        R operator()(Args... args) const {
+                assert(invoke_ptr);
+                return invoke_ptr(const_cast<std::byte*>(storage), std::forward<Args>(args)...);
+        }
+};
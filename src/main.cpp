@@ -1,10 +1,14 @@
 #include "vulkan_display.h" // Vulkan.h must be before GLFW
+#include "bc1_encoder.h"
+#include "frame_playback.h"
 #include <GLFW/glfw3.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+#include <algorithm>
 #include <atomic>
+#include <filesystem>
 #include <iostream>
 #include <string>
 #include <chrono>
@@ -162,7 +166,7 @@ int main() {
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_vulkan.h>
 
-class SDL_vulkan_display : vkd::window_changed_callback{
+class SDL_vulkan_display : vkd::window_changed_callback, vkd::frame_capture_callback {
 
         bool sdl_initialised = false;
         vkd::vulkan_display vulkan;
@@ -181,10 +185,25 @@ class SDL_vulkan_display : vkd::window_changed_callback{
 
         chrono::steady_clock::time_point time{ chrono::steady_clock::now() };
 
+        bool mipmapping = false;
+        std::atomic<bool> capturing = false;
+        uint32_t preprocess_thread_count = 0;
+        std::atomic<bool> low_latency = false;
+        bool compressed = false;
+        bool tracing = false;
+        bool color_lut = false;
+        vkd::image_transform transform{};
+        std::atomic<uint64_t> last_captured_frame = 0;
+
+        vkd::frame_playback playback;
+        uint64_t playback_frame = 0;
+        chrono::steady_clock::time_point next_playback_time{};
+
         std::thread thread;
         std::atomic<bool> should_exit = false;
 public:
-        SDL_vulkan_display() {
+        /// playback_path is an optional raw or Y4M file played instead of the test pictures
+        explicit SDL_vulkan_display(const char* playback_path = nullptr) {
                 image2.resize(size_t{ image2_height } * image2_width, { 0, 255, 255 });
                 for (uint32_t x = 0; x < image2_width; x++) {
                         if (x % 2048 < 1024) {
@@ -227,19 +246,67 @@ public:
                         throw std::runtime_error("SDL cannot create surface.");
                 }
 
-                vulkan.init(surface, 5, this);
+                vkd::display_parameters display_parameters{};
+                display_parameters.transfer_image_count = 5;
+                display_parameters.frames_in_flight = 2;
+                display_parameters.max_transfer_image_count = 8;
+                // the kept last image needs another one for the producer
+                display_parameters.min_transfer_image_count = 2;
+                vulkan.init(surface, display_parameters, this);
+                vulkan.set_keep_last_image(true);
+                if (playback_path) {
+                        playback.open(playback_path);
+                        next_playback_time = chrono::steady_clock::now();
+                }
+
+                // semi-transparent bar in the bottom left corner of the video
+                constexpr uint32_t osd_width = 256, osd_height = 32;
+                std::vector<color> osd(size_t{ osd_width } * osd_height, { 255, 255, 255, 255 });
+                uint32_t overlay_id = 0;
+                vulkan.create_overlay(overlay_id, { 0.05f, 0.85f, 0.3f, 0.1f, 0.6f });
+                vulkan.copy_and_queue_overlay_image(overlay_id, reinterpret_cast<std::byte*>(osd.data()), 
+                        { osd_width, osd_height });
                 
                 thread = std::thread{ [this]() {
                         int frame_count = 0;
                         auto time = chrono::steady_clock::now();
                         while (!should_exit) {
-                                frame_count++;
-                                vulkan.display_queued_image();
+                                bool displayed = false;
+                                vulkan.display_queued_image_for(displayed, chrono::milliseconds{ 100 });
+                                frame_count += displayed;
                                 auto now = chrono::steady_clock::now();
                                 double seconds = chrono::duration_cast<chrono::duration<double>>(now - time).count();
                                 if (seconds > 6.0) {
                                         double fps = frame_count / seconds;
-                                        std::cout << "FPS:" << fps << std::endl;
+                                        auto gpu_time = vulkan.get_gpu_time_statistics(vulkan.get_scaling_filter());
+                                        std::cout << "FPS:" << fps << " GPU time:" << gpu_time.average_ms() << "ms" << std::endl;
+                                        auto cache = vulkan.get_image_cache_statistics();
+                                        std::cout << "Image cache hits:" << cache.hits << " misses:" << cache.misses << std::endl;
+                                        auto pool = vulkan.get_transfer_pool_statistics();
+                                        std::cout << "Transfer images:" << pool.image_count << " producer stall:" << pool.stall_ms
+                                                << "ms dropped:" << pool.dropped_frames << std::endl;
+                                        auto mipmap_statistics = vulkan.get_mipmap_statistics();
+                                        if (mipmap_statistics.gpu_time.frame_count > 0) {
+                                                std::cout << "Mipmapped GPU time:" << mipmap_statistics.gpu_time.average_ms() << "ms, "
+                                                        << mipmap_statistics.generated_bytes / mipmap_statistics.gpu_time.frame_count
+                                                        << " bytes generated per frame" << std::endl;
+                                        }
+                                        auto lut_statistics = vulkan.get_color_lut_statistics();
+                                        if (lut_statistics.gpu_time.frame_count > 0) {
+                                                std::cout << "Color LUT GPU time:" << lut_statistics.gpu_time.average_ms() << "ms, last:"
+                                                        << lut_statistics.gpu_time.last_ms << "ms" << std::endl;
+                                        }
+                                        if (low_latency) {
+                                                auto latency = vulkan.get_latency_statistics();
+                                                std::cout << "Latency:" << latency.average_ms() << "ms max:" << latency.max_ms
+                                                        << "ms skipped frames:" << latency.skipped_frames << std::endl;
+                                        }
+                                        if (capturing) {
+                                                auto capture = vulkan.get_capture_statistics();
+                                                std::cout << "Captured frames:" << capture.captured_frames
+                                                        << " dropped:" << capture.dropped_frames
+                                                        << " last:" << last_captured_frame << std::endl;
+                                        }
                                         time = now;
                                         frame_count = 0;
                                 }
@@ -252,6 +319,10 @@ public:
                 if (sdl_initialised) SDL_Quit();
         }
 
+        void frame_captured(const vkd::captured_frame& frame) override {
+                last_captured_frame = frame.frame_number;
+        }
+
         vkd::window_parameters get_window_parameters() override {
                 int width, height;
                 SDL_Vulkan_GetDrawableSize(window, &width, &height);
@@ -282,8 +353,73 @@ public:
                                                         window_should_close = true;
                                                         break;
                                                 }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_m) {
+                                                        mipmapping = !mipmapping;
+                                                        vulkan.set_mipmapping(mipmapping);
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_c) {
+                                                        capturing = !capturing;
+                                                        if (capturing) {
+                                                                vulkan.start_frame_capture(this);
+                                                        } else {
+                                                                vulkan.stop_frame_capture();
+                                                        }
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_b) {
+                                                        compressed = !compressed &&
+                                                                vulkan.is_image_format_supported(vk::Format::eBc1RgbaSrgbBlock);
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_t) {
+                                                        tracing = !tracing;
+                                                        if (tracing) {
+                                                                vulkan.start_tracing();
+                                                        } else {
+                                                                vulkan.stop_tracing("trace.json");
+                                                                std::cout << "Trace written to trace.json" << std::endl;
+                                                        }
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_r) {
+                                                        auto rotation = (static_cast<uint32_t>(transform.rotation) + 1) % 4;
+                                                        transform.rotation = static_cast<vkd::image_rotation>(rotation);
+                                                        vulkan.set_image_transform(transform);
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_h) {
+                                                        transform.flip_horizontal = !transform.flip_horizontal;
+                                                        vulkan.set_image_transform(transform);
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_u) {
+                                                        color_lut = !color_lut && std::filesystem::exists("./resources/lut.cube");
+                                                        if (color_lut) {
+                                                                vkd::color_lut_data lut;
+                                                                vkd::load_cube_file(lut, "./resources/lut.cube");
+                                                                vulkan.set_color_lut(lut);
+                                                        } else {
+                                                                vulkan.disable_color_lut();
+                                                        }
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_l) {
+                                                        low_latency = !low_latency;
+                                                        vulkan.set_low_latency_mode(low_latency);
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_p) {
+                                                        preprocess_thread_count = preprocess_thread_count == 0 ? 2 : 0;
+                                                        vulkan.set_preprocess_thread_count(preprocess_thread_count);
+                                                }
+                                                if (event.key.keysym.sym == SDL_KeyCode::SDLK_f) {
+                                                        auto filter = static_cast<uint32_t>(vulkan.get_scaling_filter());
+                                                        filter = (filter + 1) % vkd::scaling_filter_count;
+                                                        vulkan.set_scaling_filter(static_cast<vkd::scaling_filter>(filter));
+                                                }
                                 }
                         }
+                        if (playback.is_open()) {
+                                playback.queue_frame(vulkan, playback_frame);
+                                playback_frame = (playback_frame + 1) % playback.get_frame_count();
+                                next_playback_time = std::max(next_playback_time + playback.get_frame_duration(),
+                                        chrono::steady_clock::now() - playback.get_frame_duration());
+                                std::this_thread::sleep_until(next_playback_time);
+                                continue;
+                        }
                         auto time = chrono::steady_clock::now();
                         double seconds = chrono::duration_cast<chrono::duration<double>>(time - this->time).count();
 
@@ -303,6 +439,13 @@ public:
                                 });
                                 vulkan.queue_image(vkd_image);
                         }
+                        else if (compressed) {
+                                vkd::image vkd_image;
+                                vulkan.acquire_image(vkd_image, { image_width, image_height, vk::Format::eBc1RgbaSrgbBlock });
+                                vkd::encode_bc1(image, size_t{ image_width } * 4, image_width, image_height,
+                                        vkd_image.get_memory_ptr(), vkd_image.get_row_pitch(), 4);
+                                vulkan.queue_image(vkd_image);
+                        }
                         else {
                                 vulkan.copy_and_queue_image(image, { image_width, image_height });
                         }
@@ -316,8 +459,8 @@ public:
         }
 };
 
-int main() {
-        SDL_vulkan_display display{};
+int main(int argc, char** argv) {
+        SDL_vulkan_display display{ argc > 1 ? argv[1] : nullptr };
         display.run();
         return 0;
 }
@@ -0,0 +1,65 @@
+#include "preprocess_pool.h"
+
+#include <cassert>
+
+namespace vulkan_display_detail {
+
+void preprocess_pool::start(uint32_t thread_count, uint32_t max_image_count,
+        process_function process, concurrent_queue<vulkan_display::image>& output)
+{
+        assert(!is_running());
+        this->process = std::move(process);
+        this->output = &output;
+        next_sequence = 0;
+        next_output_sequence = 0;
+        completed.assign(max_image_count, std::nullopt);
+
+        threads.reserve(thread_count);
+        for (uint32_t i = 0; i < thread_count; i++) {
+                threads.emplace_back([this]() { run(); });
+        }
+}
+
+void preprocess_pool::stop() {
+        for (size_t i = 0; i < threads.size(); i++) {
+                tasks.push(std::nullopt);
+        }
+        for (auto& thread : threads) {
+                thread.join();
+        }
+        threads.clear();
+}
+
+void preprocess_pool::push(vulkan_display::image image) {
+        assert(is_running());
+        tasks.push(task{ image, next_sequence++ });
+}
+
+void preprocess_pool::run() {
+        while (true) {
+                std::optional<task> current = tasks.pop();
+                if (!current.has_value()) {
+                        return;
+                }
+                if (current->image.get_transfer_image()) {
+                        process(current->image);
+                }
+
+                std::scoped_lock lock(reorder_mutex);
+                auto& slot = completed[current->sequence % completed.size()];
+                assert(!slot.has_value());
+                slot = current->image;
+                // frames finished earlier than their predecessors wait for them
+                while (true) {
+                        auto& next = completed[next_output_sequence % completed.size()];
+                        if (!next.has_value()) {
+                                break;
+                        }
+                        output->push(*next);
+                        next.reset();
+                        next_output_sequence++;
+                }
+        }
+}
+
+} // vulkan_display_detail
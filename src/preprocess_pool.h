@@ -0,0 +1,62 @@
+#pragma once
+#include "concurent_queue.h"
+#include "vulkan_transfer_image.h"
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace vulkan_display_detail {
+
+/**
+ * Worker threads converting queued images in parallel,
+ * converted images are pushed to the output queue in the same order as they were queued
+ */
+class preprocess_pool {
+public:
+        using process_function = inplace_function<void(vulkan_display::image& image), 16>;
+
+private:
+        struct task {
+                vulkan_display::image image;
+                uint64_t sequence;
+        };
+
+        std::vector<std::thread> threads{};
+        concurrent_queue<std::optional<task>> tasks{}; // empty task stops one thread
+        process_function process{};
+        concurrent_queue<vulkan_display::image>* output = nullptr;
+
+        std::atomic<uint64_t> next_sequence = 0;
+        std::mutex reorder_mutex{};
+        std::vector<std::optional<vulkan_display::image>> completed{}; // indexed by sequence modulo size
+        uint64_t next_output_sequence = 0;
+
+        void run();
+
+public:
+        preprocess_pool() = default;
+        preprocess_pool(const preprocess_pool& other) = delete;
+        preprocess_pool& operator=(const preprocess_pool& other) = delete;
+
+        ~preprocess_pool() {
+                stop();
+        }
+
+        /// max_image_count is the maximal number of images which can be in the pool at once
+        void start(uint32_t thread_count, uint32_t max_image_count,
+                process_function process, concurrent_queue<vulkan_display::image>& output);
+
+        /// all queued images are processed and pushed to the output before the function returns
+        void stop();
+
+        bool is_running() const {
+                return !threads.empty();
+        }
+
+        void push(vulkan_display::image image);
+};
+
+} // vulkan_display_detail
@@ -0,0 +1,73 @@
+#include "transfer_pool_sizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <iostream>
+
+namespace {
+
+// producers waiting longer than this fraction of the interval need more images
+constexpr double grow_stall_fraction = 0.02;
+// at least this many images have to stay unused for the whole interval before one is retired
+constexpr size_t shrink_min_available = 2;
+
+} // namespace --------------------------------------------------------------
+
+namespace vulkan_display_detail {
+
+void transfer_pool_sizer::init(uint32_t min_count, uint32_t max_count, uint32_t image_count) {
+        assert(min_count <= image_count && image_count <= max_count);
+        std::scoped_lock lock(mutex);
+        this->min_count = min_count;
+        this->max_count = max_count;
+        statistics = {};
+        statistics.image_count = image_count;
+        interval_start = clock::now();
+}
+
+void transfer_pool_sizer::record_acquire(clock::duration stall, size_t available_count, bool dropped) {
+        std::scoped_lock lock(mutex);
+        statistics.stall_ms += std::chrono::duration<double, std::milli>(stall).count();
+        interval_stall += stall;
+        interval_acquires++;
+        if (dropped) {
+                statistics.dropped_frames++;
+                interval_drops++;
+        }
+        interval_min_available = std::min(interval_min_available, available_count);
+}
+
+int transfer_pool_sizer::evaluate(clock::time_point now) {
+        std::scoped_lock lock(mutex);
+        auto elapsed = now - interval_start;
+        if (elapsed < interval || interval_acquires == 0) {
+                return 0;
+        }
+        double stall_fraction = std::chrono::duration<double>(interval_stall) / elapsed;
+        bool images_unused = interval_min_available >= shrink_min_available;
+
+        int change = 0;
+        if (stall_fraction > grow_stall_fraction && interval_drops == 0 && statistics.image_count < max_count) {
+                change = 1;
+                statistics.grow_count++;
+        } else if (stall_fraction == 0.0 && (interval_drops > 0 || images_unused) && statistics.image_count > min_count) {
+                // dropped frames mean the display is slower than producers, more images would only add latency
+                change = -1;
+                statistics.shrink_count++;
+        }
+        if (change != 0) {
+                statistics.image_count += change;
+                std::cout << "Transfer image pool " << (change > 0 ? "grows" : "shrinks") << " to "
+                        << statistics.image_count << " images (stalled " << stall_fraction * 100.0 << "%, "
+                        << interval_drops << " dropped, " << interval_min_available << " unused)" << std::endl;
+        }
+
+        interval_start = now;
+        interval_stall = {};
+        interval_acquires = 0;
+        interval_drops = 0;
+        interval_min_available = SIZE_MAX;
+        return change;
+}
+
+} // vulkan_display_detail
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace vulkan_display {
+
+struct transfer_pool_statistics {
+        uint32_t image_count = 0;       ///< transfer images currently used by producers and the display
+        uint64_t grow_count = 0;
+        uint64_t shrink_count = 0;
+        double stall_ms = 0.0;          ///< total time producers waited for an available image
+        uint64_t dropped_frames = 0;    ///< queued images taken back by producers, because the display was too slow
+};
+
+} // vulkan_display
+
+namespace vulkan_display_detail {
+
+/**
+ * Decides the number of transfer images from producer stalls, available images and dropped frames,
+ * the decision is made at most once per interval, so the pool doesn't oscillate
+ */
+class transfer_pool_sizer {
+public:
+        using clock = std::chrono::steady_clock;
+
+private:
+        std::mutex mutex{};
+        uint32_t min_count = 0;
+        uint32_t max_count = 0;
+        vulkan_display::transfer_pool_statistics statistics{};
+
+        clock::time_point interval_start{};
+        clock::duration interval_stall{};
+        uint64_t interval_acquires = 0;
+        uint64_t interval_drops = 0;
+        size_t interval_min_available = SIZE_MAX;
+
+public:
+        static constexpr auto interval = std::chrono::seconds{ 1 };
+
+        void init(uint32_t min_count, uint32_t max_count, uint32_t image_count);
+
+        /// available_count is the number of available images when the acquire started
+        void record_acquire(clock::duration stall, size_t available_count, bool dropped);
+
+        /// returns +1 if an image should be added, -1 if one should be retired, the change is already applied
+        int evaluate(clock::time_point now);
+
+        vulkan_display::transfer_pool_statistics get_statistics() {
+                std::scoped_lock lock(mutex);
+                return statistics;
+        }
+};
+
+} // vulkan_display_detail
@@ -0,0 +1,347 @@
+#include "vulkan_color_lut.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace vulkan_display_detail;
+
+namespace {
+
+uint16_t to_half_float(float value) {
+        uint32_t bits = 0;
+        std::memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        uint32_t float_exponent = (bits >> 23) & 0xff;
+        uint32_t mantissa = bits & 0x7fffff;
+        if (float_exponent == 0xff) {
+                // infinity or NaN
+                return static_cast<uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+        }
+        int32_t exponent = static_cast<int32_t>(float_exponent) - 127 + 15;
+        if (exponent >= 31) {
+                return static_cast<uint16_t>(sign | 0x7c00);
+        }
+        if (exponent <= 0) {
+                // denormal half float, values below half of the smallest one are flushed to zero
+                if (exponent < -10) {
+                        return static_cast<uint16_t>(sign);
+                }
+                mantissa |= 0x800000;
+                uint32_t shift = static_cast<uint32_t>(14 - exponent);
+                uint32_t result = mantissa >> shift;
+                uint32_t remainder = mantissa & ((1u << shift) - 1);
+                uint32_t halfway = 1u << (shift - 1);
+                if (remainder > halfway || (remainder == halfway && (result & 1))) {
+                        result++;
+                }
+                return static_cast<uint16_t>(sign | result);
+        }
+        // rounding to nearest even, the carry may correctly overflow into the exponent
+        uint32_t result = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1fff;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1))) {
+                result++;
+        }
+        return static_cast<uint16_t>(result);
+}
+
+vk::ImageMemoryBarrier create_barrier(vk::Image image, vk::ImageLayout old_layout, vk::ImageLayout new_layout,
+        vk::AccessFlags old_access, vk::AccessFlags new_access)
+{
+        vk::ImageMemoryBarrier memory_barrier{};
+        memory_barrier
+                .setImage(image)
+                .setOldLayout(old_layout)
+                .setNewLayout(new_layout)
+                .setSrcAccessMask(old_access)
+                .setDstAccessMask(new_access)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        memory_barrier.subresourceRange
+                .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                .setLevelCount(1)
+                .setLayerCount(1);
+        return memory_barrier;
+}
+
+vulkan_display::color_lut_data create_identity_lut() {
+        vulkan_display::color_lut_data lut{};
+        lut.size = 2;
+        for (uint32_t b = 0; b < 2; b++) {
+                for (uint32_t g = 0; g < 2; g++) {
+                        for (uint32_t r = 0; r < 2; r++) {
+                                lut.rgb.insert(lut.rgb.end(),
+                                        { static_cast<float>(r), static_cast<float>(g), static_cast<float>(b) });
+                        }
+                }
+        }
+        return lut;
+}
+
+} //namespace -------------------------------------------------------------
+
+namespace vulkan_display {
+
+RETURN_TYPE load_cube_file(color_lut_data& lut, const std::filesystem::path& path) {
+        std::ifstream file(path);
+        CHECK(file.is_open(), "Failed to open file:"s + path.string());
+        lut = color_lut_data{};
+        std::string line;
+        while (std::getline(file, line)) {
+                line = line.substr(0, line.find('#'));
+                std::istringstream stream(line);
+                std::string keyword;
+                if (!(stream >> keyword)) {
+                        continue;
+                }
+                if (keyword == "TITLE") {
+                        continue;
+                } else if (keyword == "LUT_3D_SIZE") {
+                        stream >> lut.size;
+                        CHECK(!stream.fail() && lut.size >= 2 && lut.size <= color_lut::max_size,
+                                "Invalid LUT_3D_SIZE in file:"s + path.string());
+                        lut.rgb.reserve(size_t{ lut.size } * lut.size * lut.size * 3);
+                } else if (keyword == "DOMAIN_MIN" || keyword == "DOMAIN_MAX") {
+                        auto& domain = keyword == "DOMAIN_MIN" ? lut.domain_min : lut.domain_max;
+                        stream >> domain[0] >> domain[1] >> domain[2];
+                        CHECK(!stream.fail(), "Invalid "s + keyword + " in file:" + path.string());
+                } else if (keyword == "LUT_3D_INPUT_RANGE") {
+                        float min = 0.f, max = 0.f;
+                        stream >> min >> max;
+                        CHECK(!stream.fail(), "Invalid LUT_3D_INPUT_RANGE in file:"s + path.string());
+                        lut.domain_min = { min, min, min };
+                        lut.domain_max = { max, max, max };
+                } else if (keyword == "LUT_1D_SIZE" || keyword == "LUT_1D_INPUT_RANGE") {
+                        CHECK(false, "1D LUTs are not supported, file:"s + path.string());
+                } else {
+                        std::istringstream values(line);
+                        float r = 0.f, g = 0.f, b = 0.f;
+                        values >> r >> g >> b;
+                        CHECK(!values.fail() && lut.size != 0, "Unexpected line in file:"s + path.string() + ": " + line);
+                        lut.rgb.insert(lut.rgb.end(), { r, g, b });
+                }
+        }
+        CHECK(lut.size != 0 && lut.rgb.size() == size_t{ lut.size } * lut.size * lut.size * 3,
+                "Wrong number of LUT entries in file:"s + path.string());
+        for (size_t i = 0; i < 3; i++) {
+                CHECK(lut.domain_max[i] > lut.domain_min[i], "Empty LUT domain in file:"s + path.string());
+        }
+        return RETURN_TYPE();
+}
+
+} // vulkan_display
+
+namespace vulkan_display_detail {
+
+RETURN_TYPE color_lut::init(vk::Device device) {
+        vk::SamplerCreateInfo sampler_info{};
+        sampler_info
+                .setMagFilter(vk::Filter::eLinear)
+                .setMinFilter(vk::Filter::eLinear)
+                .setMipmapMode(vk::SamplerMipmapMode::eNearest)
+                .setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+                .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+                .setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+                .setMaxLod(0.f);
+        CHECKED_ASSIGN(sampler, device.createSampler(sampler_info));
+
+        vk::DescriptorSetLayoutBinding binding{};
+        binding
+                .setBinding(0)
+                .setDescriptorCount(1)
+                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                .setStageFlags(vk::ShaderStageFlagBits::eFragment)
+                .setPImmutableSamplers(&sampler);
+        vk::DescriptorSetLayoutCreateInfo layout_info{};
+        layout_info
+                .setBindingCount(1)
+                .setPBindings(&binding);
+        CHECKED_ASSIGN(descriptor_set_layout, device.createDescriptorSetLayout(layout_info));
+
+        auto set_count = static_cast<uint32_t>(descriptor_sets.size());
+        vk::DescriptorPoolSize pool_size{ vk::DescriptorType::eCombinedImageSampler, set_count };
+        vk::DescriptorPoolCreateInfo pool_info{};
+        pool_info
+                .setPoolSizeCount(1)
+                .setPPoolSizes(&pool_size)
+                .setMaxSets(set_count);
+        CHECKED_ASSIGN(descriptor_pool, device.createDescriptorPool(pool_info));
+
+        std::array layouts{ descriptor_set_layout, descriptor_set_layout };
+        vk::DescriptorSetAllocateInfo allocate_info{};
+        allocate_info
+                .setDescriptorPool(descriptor_pool)
+                .setDescriptorSetCount(set_count)
+                .setPSetLayouts(layouts.data());
+        std::vector<vk::DescriptorSet> sets;
+        CHECKED_ASSIGN(sets, device.allocateDescriptorSets(allocate_info));
+        std::copy(sets.begin(), sets.end(), descriptor_sets.begin());
+
+        set(create_identity_lut());
+        return RETURN_TYPE();
+}
+
+void color_lut::set(const vulkan_display::color_lut_data& lut) {
+        assert(lut.size >= 2 && lut.rgb.size() == size_t{ lut.size } * lut.size * lut.size * 3);
+        // conversion runs on the calling thread, the display thread only copies the texels
+        std::vector<uint16_t> texels(lut.rgb.size() / 3 * 4);
+        for (size_t i = 0; i < lut.rgb.size() / 3; i++) {
+                texels[4 * i + 0] = to_half_float(lut.rgb[3 * i + 0]);
+                texels[4 * i + 1] = to_half_float(lut.rgb[3 * i + 1]);
+                texels[4 * i + 2] = to_half_float(lut.rgb[3 * i + 2]);
+                texels[4 * i + 3] = to_half_float(1.f);
+        }
+        lut_image parameters{};
+        parameters.size = lut.size;
+        parameters.domain_min = lut.domain_min;
+        for (size_t i = 0; i < 3; i++) {
+                parameters.domain_scale[i] = 1.f / (lut.domain_max[i] - lut.domain_min[i]);
+        }
+
+        std::scoped_lock lock(pending_mutex);
+        pending = true;
+        pending_parameters = parameters;
+        pending_texels = std::move(texels);
+}
+
+RETURN_TYPE color_lut::create_image(lut_image& image, vk::Device device, vk::PhysicalDevice gpu, uint32_t size) {
+        device.destroy(image.view);
+        device.destroy(image.image);
+        device.freeMemory(image.memory);
+        image.size = size;
+
+        vk::ImageCreateInfo image_info;
+        image_info
+                .setImageType(vk::ImageType::e3D)
+                .setExtent(vk::Extent3D{ size, size, size })
+                .setMipLevels(1)
+                .setArrayLayers(1)
+                .setFormat(format)
+                .setTiling(vk::ImageTiling::eOptimal)
+                .setInitialLayout(vk::ImageLayout::eUndefined)
+                .setUsage(vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setSamples(vk::SampleCountFlagBits::e1);
+        CHECKED_ASSIGN(image.image, device.createImage(image_info));
+
+        vk::MemoryRequirements memory_requirements = device.getImageMemoryRequirements(image.image);
+        uint32_t memory_type = 0;
+        PASS_RESULT(get_memory_type(memory_type, memory_requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags{}, gpu));
+        vk::MemoryAllocateInfo allocate_info{ memory_requirements.size, memory_type };
+        CHECKED_ASSIGN(image.memory, device.allocateMemory(allocate_info));
+        PASS_RESULT(device.bindImageMemory(image.image, image.memory, 0));
+
+        vk::ImageViewCreateInfo view_info = vulkan_display::default_image_view_create_info(format);
+        view_info
+                .setImage(image.image)
+                .setViewType(vk::ImageViewType::e3D);
+        CHECKED_ASSIGN(image.view, device.createImageView(view_info));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE color_lut::prepare_upload(vk::Device device, vk::PhysicalDevice gpu, vk::Semaphore timeline) {
+        auto& back = images[1 - front];
+        lut_image parameters{};
+        std::vector<uint16_t> texels;
+        {
+                std::scoped_lock lock(pending_mutex);
+                if (!pending) {
+                        return RETURN_TYPE();
+                }
+                // the back image was sampled by earlier frames and the staging buffer was read by the previous upload,
+                // the caller holds device_mutex, so the swap is postponed instead of waiting for them
+                uint64_t finished_frame = 0;
+                CHECKED_ASSIGN(finished_frame, device.getSemaphoreCounterValue(timeline));
+                if (finished_frame < std::max(back.last_used_frame, staging_used_frame)) {
+                        return RETURN_TYPE();
+                }
+                pending = false;
+                parameters = pending_parameters;
+                texels = std::move(pending_texels);
+        }
+        if (back.size != parameters.size) {
+                PASS_RESULT(create_image(back, device, gpu, parameters.size));
+
+                vk::DescriptorImageInfo image_info{ nullptr, back.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+                vk::WriteDescriptorSet descriptor_write{};
+                descriptor_write
+                        .setDstSet(descriptor_sets[1 - front])
+                        .setDstBinding(0)
+                        .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                        .setDescriptorCount(1)
+                        .setPImageInfo(&image_info);
+                device.updateDescriptorSets(descriptor_write, nullptr);
+        }
+        back.domain_min = parameters.domain_min;
+        back.domain_scale = parameters.domain_scale;
+
+        vk::DeviceSize byte_size = texels.size() * sizeof(uint16_t);
+        if (staging_size < byte_size) {
+                device.destroy(staging_buffer);
+                device.freeMemory(staging_memory);
+                staging_size = byte_size;
+                PASS_RESULT(create_host_buffer(staging_buffer, staging_memory, staging_ptr,
+                        device, gpu, staging_size, vk::BufferUsageFlagBits::eTransferSrc));
+        }
+        std::memcpy(staging_ptr, texels.data(), byte_size);
+        upload_prepared = true;
+        return RETURN_TYPE();
+}
+
+void color_lut::record(vk::CommandBuffer cmd_buffer, uint64_t frame_number) {
+        uploaded_bytes = 0;
+        if (upload_prepared) {
+                upload_prepared = false;
+                using layout = vk::ImageLayout;
+                using access = vk::AccessFlagBits;
+                using stage = vk::PipelineStageFlagBits;
+                auto& back = images[1 - front];
+
+                // frames sampling the previous contents were finished when prepare_upload took the LUT
+                auto transfer_barrier = create_barrier(back.image, layout::eUndefined, layout::eTransferDstOptimal,
+                        {}, access::eTransferWrite);
+                cmd_buffer.pipelineBarrier(stage::eTopOfPipe, stage::eTransfer,
+                        vk::DependencyFlags{}, nullptr, nullptr, transfer_barrier);
+                vk::BufferImageCopy copy{};
+                copy.imageSubresource
+                        .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                        .setLayerCount(1);
+                copy.setImageExtent(vk::Extent3D{ back.size, back.size, back.size });
+                cmd_buffer.copyBufferToImage(staging_buffer, back.image, layout::eTransferDstOptimal, copy);
+                auto sample_barrier = create_barrier(back.image, layout::eTransferDstOptimal, layout::eShaderReadOnlyOptimal,
+                        access::eTransferWrite, access::eShaderRead);
+                cmd_buffer.pipelineBarrier(stage::eTransfer, stage::eFragmentShader,
+                        vk::DependencyFlags{}, nullptr, nullptr, sample_barrier);
+
+                uploaded_bytes = vk::DeviceSize{ back.size } * back.size * back.size * 4 * sizeof(uint16_t);
+                staging_used_frame = frame_number;
+                front = 1 - front;
+        }
+        images[front].last_used_frame = frame_number;
+}
+
+void color_lut::destroy(vk::Device device) {
+        for (auto& image : images) {
+                device.destroy(image.view);
+                device.destroy(image.image);
+                device.freeMemory(image.memory);
+                image = lut_image{};
+        }
+        device.destroy(staging_buffer);
+        device.freeMemory(staging_memory);
+        staging_buffer = nullptr;
+        staging_memory = nullptr;
+        staging_size = 0;
+        device.destroy(descriptor_pool);
+        device.destroy(descriptor_set_layout);
+        device.destroy(sampler);
+        descriptor_pool = nullptr;
+        descriptor_set_layout = nullptr;
+        sampler = nullptr;
+}
+
+} // vulkan_display_detail
@@ -0,0 +1,119 @@
+#pragma once
+#include "vulkan_context.h"
+
+#include <array>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+namespace vulkan_display {
+
+enum class lut_interpolation : uint32_t {
+        trilinear,      ///< filtered by the sampler, may show hue shifts along the neutral axis
+        tetrahedral,    ///< four entries of the enclosing tetrahedron, preserves the neutral axis
+};
+
+/// 3D LUT with the red index changing fastest, the order used by .cube files
+struct color_lut_data {
+        uint32_t size = 0;                      ///< entries along every axis, e.g. 33 or 65
+        std::vector<float> rgb{};               ///< size^3 rgb triplets
+        std::array<float, 3> domain_min{ 0.f, 0.f, 0.f };
+        std::array<float, 3> domain_max{ 1.f, 1.f, 1.f };
+};
+
+/// reads LUT_3D_SIZE, DOMAIN_MIN, DOMAIN_MAX and the table of a .cube file, 1D LUTs are rejected
+RETURN_TYPE load_cube_file(color_lut_data& lut, const std::filesystem::path& path);
+
+} // vulkan_display
+
+namespace vulkan_display_detail {
+
+/**
+ * 3D texture sampled by the fragment shader through its own descriptor set, so a new LUT only swaps
+ * the bound set. Two images are used, the new LUT is uploaded into the one not sampled by frames in flight.
+ */
+class color_lut {
+        struct lut_image {
+                vk::DeviceMemory memory;
+                vk::Image image;
+                vk::ImageView view;
+                uint32_t size = 0;
+                std::array<float, 3> domain_min{};
+                std::array<float, 3> domain_scale{};
+                uint64_t last_used_frame = 0; ///< last frame sampling the image, 0 if none
+        };
+
+        vk::Sampler sampler;
+        vk::DescriptorSetLayout descriptor_set_layout;
+        vk::DescriptorPool descriptor_pool;
+        std::array<vk::DescriptorSet, 2> descriptor_sets{};
+        std::array<lut_image, 2> images{};
+        uint32_t front = 0;
+
+        vk::Buffer staging_buffer;
+        vk::DeviceMemory staging_memory;
+        void* staging_ptr = nullptr;
+        vk::DeviceSize staging_size = 0;
+        uint64_t staging_used_frame = 0;
+        bool upload_prepared = false;
+        vk::DeviceSize uploaded_bytes = 0;
+
+        // half float texels converted by the thread calling set, taken by the display thread
+        std::mutex pending_mutex{};
+        bool pending = false;
+        lut_image pending_parameters{};
+        std::vector<uint16_t> pending_texels{};
+
+        RETURN_TYPE create_image(lut_image& image, vk::Device device, vk::PhysicalDevice gpu, uint32_t size);
+
+public:
+        /// half float texels can be filtered linearly on every gpu
+        static constexpr vk::Format format = vk::Format::eR16G16B16A16Sfloat;
+
+        /// minimal maxImageDimension3D guaranteed by vulkan
+        static constexpr uint32_t max_size = 256;
+
+        /// the identity LUT is uploaded with the first frame, so the descriptor set is always valid
+        RETURN_TYPE init(vk::Device device);
+
+        vk::DescriptorSetLayout get_descriptor_set_layout() const {
+                return descriptor_set_layout;
+        }
+
+        /// can be called from any thread, only the last LUT set before the next frame is uploaded
+        void set(const vulkan_display::color_lut_data& lut);
+
+        /**
+         * Fills the staging buffer if the gpu finished the frames using the back image and the staging buffer,
+         * otherwise the LUT stays pending for a later frame. Only the counter of the timeline is read.
+         */
+        RETURN_TYPE prepare_upload(vk::Device device, vk::PhysicalDevice gpu, vk::Semaphore timeline);
+
+        /// records the prepared upload, the uploaded LUT is sampled by this and following frames
+        void record(vk::CommandBuffer cmd_buffer, uint64_t frame_number);
+
+        /// bytes copied by the last recorded upload, 0 if the LUT didn't change
+        vk::DeviceSize get_uploaded_byte_count() const {
+                return uploaded_bytes;
+        }
+
+        vk::DescriptorSet get_descriptor_set() const {
+                return descriptor_sets[front];
+        }
+
+        uint32_t get_size() const {
+                return images[front].size;
+        }
+
+        const std::array<float, 3>& get_domain_min() const {
+                return images[front].domain_min;
+        }
+
+        const std::array<float, 3>& get_domain_scale() const {
+                return images[front].domain_scale;
+        }
+
+        void destroy(vk::Device device);
+};
+
+} // vulkan_display_detail
@@ -1,4 +1,5 @@
 #include "vulkan_context.h"
+#include "frame_trace.h"
 #include <cassert>
 #include <iostream>
 
@@ -114,11 +115,34 @@ RETURN_TYPE get_queue_family_index(uint32_t& index, vk::PhysicalDevice gpu, vk::
 
 const std::vector required_gpu_extensions = { "VK_KHR_swapchain" };
 
+RETURN_TYPE check_timeline_semaphore_support(bool& result, bool propagate_error, vk::PhysicalDevice gpu) {
+        result = false;
+        if (gpu.getProperties().apiVersion < VK_API_VERSION_1_2) {
+                if (propagate_error) {
+                        CHECK(false, "Vulkan 1.2 is not supported by the device.");
+                }
+                return RETURN_TYPE();
+        }
+        auto features = gpu.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+        if (!features.get<vk::PhysicalDeviceVulkan12Features>().timelineSemaphore) {
+                if (propagate_error) {
+                        CHECK(false, "Timeline semaphores are not supported by the device.");
+                }
+                return RETURN_TYPE();
+        }
+        result = true;
+        return RETURN_TYPE();
+}
+
 RETURN_TYPE is_gpu_suitable(bool& result, bool propagate_error, vk::PhysicalDevice gpu, vk::SurfaceKHR surface = nullptr) {
         PASS_RESULT(check_device_extensions(result, propagate_error, required_gpu_extensions, gpu));
         if (!result) {
                 return RETURN_TYPE();
         }
+        PASS_RESULT(check_timeline_semaphore_support(result, propagate_error, gpu));
+        if (!result) {
+                return RETURN_TYPE();
+        }
         uint32_t index = NO_QUEUE_FAMILY_INDEX_FOUND;
         PASS_RESULT(get_queue_family_index(index, gpu, surface));
         if (index == NO_QUEUE_FAMILY_INDEX_FOUND) {
@@ -180,6 +204,14 @@ RETURN_TYPE choose_gpu_by_index(vk::PhysicalDevice& gpu, std::vector<vk::Physica
         return RETURN_TYPE();
 }
 
+/**
+ * Check if the required flags are present among the provided flags
+ */
+template<typename T>
+bool flags_present(T provided_flags, T required_flags) {
+        return (provided_flags & required_flags) == required_flags;
+}
+
 vk::CompositeAlphaFlagBitsKHR get_composite_alpha(vk::CompositeAlphaFlagsKHR capabilities) {
         uint32_t result = 1;
         while (!(result & static_cast<uint32_t>(capabilities))) {
@@ -193,6 +225,137 @@ vk::CompositeAlphaFlagBitsKHR get_composite_alpha(vk::CompositeAlphaFlagsKHR cap
 
 namespace vulkan_display_detail { //------------------------------------------------------------------------
 
+RETURN_TYPE get_memory_type(
+        uint32_t& memory_type, uint32_t memory_type_bits,
+        vk::MemoryPropertyFlags requested_properties, vk::MemoryPropertyFlags optional_properties,
+        vk::PhysicalDevice gpu)
+{
+        uint32_t possible_memory_type = UINT32_MAX;
+        auto supported_properties = gpu.getMemoryProperties();
+        for (uint32_t i = 0; i < supported_properties.memoryTypeCount; i++) {
+                // if i-th bit in memory_type_bits is set, than i-th memory type can be used
+                bool is_type_usable = (1u << i) & memory_type_bits;
+                auto& mem_type = supported_properties.memoryTypes[i];
+                if (flags_present(mem_type.propertyFlags, requested_properties) && is_type_usable) {
+                        if (flags_present(mem_type.propertyFlags, optional_properties)) {
+                                memory_type = i;
+                                return RETURN_TYPE();
+                        }
+                        possible_memory_type = i;
+                }
+        }
+        if (possible_memory_type != UINT32_MAX) {
+                memory_type = possible_memory_type;
+                return RETURN_TYPE();
+        }
+        CHECK(false, "No available memory type found.");
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE wait_for_timeline_value(vk::Device device, vk::Semaphore timeline, uint64_t value) {
+        bool reached = false;
+        PASS_RESULT(wait_for_timeline_value(reached, device, timeline, value, UINT64_MAX));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE wait_for_timeline_value(bool& reached, vk::Device device, vk::Semaphore timeline, uint64_t value,
+        uint64_t timeout_ns)
+{
+        uint64_t completed_value = 0;
+        CHECKED_ASSIGN(completed_value, device.getSemaphoreCounterValue(timeline));
+        reached = completed_value >= value;
+        if (reached) {
+                return RETURN_TYPE();
+        }
+        vk::SemaphoreWaitInfo wait_info{};
+        wait_info
+                .setSemaphoreCount(1)
+                .setPSemaphores(&timeline)
+                .setPValues(&value);
+        auto result = device.waitSemaphores(wait_info, timeout_ns);
+        CHECK(result == vk::Result::eSuccess || result == vk::Result::eTimeout, "Waiting for timeline semaphore failed.");
+        reached = result == vk::Result::eSuccess;
+        return RETURN_TYPE();
+}
+
+vk::DeviceSize get_pixel_size(vk::Format format) {
+        using f = vk::Format;
+        switch (format) {
+        case f::eR8G8B8A8Unorm:
+        case f::eR8G8B8A8Srgb:
+        case f::eB8G8R8A8Unorm:
+        case f::eB8G8R8A8Srgb:
+        case f::eA2B10G10R10UnormPack32:
+        case f::eA2R10G10B10UnormPack32:
+                return 4;
+        case f::eR16G16B16A16Unorm:
+        case f::eR16G16B16A16Sfloat:
+                return 8;
+        case f::eR32G32B32A32Sfloat:
+                return 16;
+        default:
+                return 0;
+        }
+}
+
+bool is_srgb_format(vk::Format format) {
+        using f = vk::Format;
+        switch (format) {
+        case f::eR8G8B8A8Srgb:
+        case f::eB8G8R8A8Srgb:
+        case f::eBc1RgbSrgbBlock:
+        case f::eBc1RgbaSrgbBlock:
+        case f::eBc3SrgbBlock:
+        case f::eBc7SrgbBlock:
+                return true;
+        default:
+                return false;
+        }
+}
+
+vk::DeviceSize get_compressed_block_size(vk::Format format) {
+        using f = vk::Format;
+        switch (format) {
+        case f::eBc1RgbUnormBlock:
+        case f::eBc1RgbSrgbBlock:
+        case f::eBc1RgbaUnormBlock:
+        case f::eBc1RgbaSrgbBlock:
+                return 8;
+        case f::eBc3UnormBlock:
+        case f::eBc3SrgbBlock:
+        case f::eBc7UnormBlock:
+        case f::eBc7SrgbBlock:
+                return 16;
+        default:
+                return 0;
+        }
+}
+
+RETURN_TYPE create_host_buffer(vk::Buffer& buffer, vk::DeviceMemory& memory, void*& ptr,
+        vk::Device device, vk::PhysicalDevice gpu, vk::DeviceSize size, vk::BufferUsageFlags usage,
+        vk::MemoryPropertyFlags optional_properties)
+{
+        vk::BufferCreateInfo buffer_info{};
+        buffer_info
+                .setSize(size)
+                .setUsage(usage)
+                .setSharingMode(vk::SharingMode::eExclusive);
+        CHECKED_ASSIGN(buffer, device.createBuffer(buffer_info));
+
+        vk::MemoryRequirements memory_requirements = device.getBufferMemoryRequirements(buffer);
+        using mem_bits = vk::MemoryPropertyFlagBits;
+        uint32_t memory_type = 0;
+        PASS_RESULT(get_memory_type(memory_type, memory_requirements.memoryTypeBits,
+                mem_bits::eHostVisible | mem_bits::eHostCoherent, optional_properties, gpu));
+
+        vk::MemoryAllocateInfo allocate_info{ memory_requirements.size, memory_type };
+        CHECKED_ASSIGN(memory, device.allocateMemory(allocate_info));
+        PASS_RESULT(device.bindBufferMemory(buffer, memory, 0));
+        CHECKED_ASSIGN(ptr, device.mapMemory(memory, 0, size));
+        CHECK(ptr != nullptr, "Buffer memory cannot be mapped.");
+        return RETURN_TYPE();
+}
+
 RETURN_TYPE vulkan_context::create_instance(std::vector<c_str>& required_extensions, bool enable_validation) {
         this->validation_enabled = enable_validation;
 
@@ -208,7 +371,8 @@ RETURN_TYPE vulkan_context::create_instance(std::vector<c_str>& required_extensi
         PASS_RESULT(check_instance_extensions(required_extensions));
 
         vk::ApplicationInfo app_info{};
-        app_info.setApiVersion(VK_API_VERSION_1_0);
+        // gpu completion is tracked by timeline semaphores, which are core since 1.2
+        app_info.setApiVersion(VK_API_VERSION_1_2);
 
         vk::InstanceCreateInfo instance_info{};
         instance_info
@@ -284,12 +448,29 @@ RETURN_TYPE vulkan_context::create_logical_device() {
                 .setPQueuePriorities(priorities.data())
                 .setQueueCount(1);
 
+        vk::PhysicalDeviceVulkan12Features features{};
+        features.setTimelineSemaphore(true);
+
+        // compressed formats are used only if the application queues them
+        texture_compression_bc = gpu.getFeatures().textureCompressionBC;
+        vk::PhysicalDeviceFeatures enabled_features{};
+        enabled_features.setTextureCompressionBC(texture_compression_bc);
+
+        // memory budget is optional, without it only heap sizes are known
+        std::vector<c_str> extensions = required_gpu_extensions;
+        PASS_RESULT(check_device_extensions(memory_budget_supported, false, { VK_EXT_MEMORY_BUDGET_EXTENSION_NAME }, gpu));
+        if (memory_budget_supported) {
+                extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+
         vk::DeviceCreateInfo device_info{};
         device_info
+                .setPNext(&features)
                 .setQueueCreateInfoCount(1)
                 .setPQueueCreateInfos(&queue_info)
-                .setEnabledExtensionCount(static_cast<uint32_t>(required_gpu_extensions.size()))
-                .setPpEnabledExtensionNames(required_gpu_extensions.data());
+                .setPEnabledFeatures(&enabled_features)
+                .setEnabledExtensionCount(static_cast<uint32_t>(extensions.size()))
+                .setPpEnabledExtensionNames(extensions.data());
 
         CHECKED_ASSIGN(device, gpu.createDevice(device_info));
         return RETURN_TYPE();
@@ -353,11 +534,24 @@ RETURN_TYPE vulkan_context::create_swap_chain(vk::SwapchainKHR old_swapchain) {
                 capabilities.maxImageExtent.height);
 
         uint32_t image_count = capabilities.minImageCount + 1;
+        if (low_latency) {
+                // every additional image can hold one more frame between the render and the scanout
+                image_count = capabilities.minImageCount;
+        } else if (requested_swapchain_image_count != 0) {
+                image_count = std::max(requested_swapchain_image_count, capabilities.minImageCount);
+        }
         if (capabilities.maxImageCount != 0) {
                 image_count = std::min(image_count, capabilities.maxImageCount);
         }
 
-        //assert(capabilities.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst);
+        vk::ImageUsageFlags usage = vk::ImageUsageFlagBits::eColorAttachment;
+        if (swapchain_readback) {
+                // transfer usage can disable framebuffer compression, so it is requested only when needed
+                CHECK(flags_present(capabilities.supportedUsageFlags, vk::ImageUsageFlags{ vk::ImageUsageFlagBits::eTransferSrc }),
+                        "Swapchain images cannot be read back.");
+                usage |= vk::ImageUsageFlagBits::eTransferSrc;
+        }
+
         vk::SwapchainCreateInfoKHR swapchain_info{};
         swapchain_info
                 .setSurface(surface)
@@ -367,7 +561,7 @@ RETURN_TYPE vulkan_context::create_swap_chain(vk::SwapchainKHR old_swapchain) {
                 .setMinImageCount(image_count)
                 .setImageExtent(window_size)
                 .setImageArrayLayers(1)
-                .setImageUsage(vk::ImageUsageFlagBits::eColorAttachment)
+                .setImageUsage(usage)
                 .setImageSharingMode(vk::SharingMode::eExclusive)
                 .setPreTransform(swapchain_atributes.capabilities.currentTransform)
                 .setCompositeAlpha(get_composite_alpha(swapchain_atributes.capabilities.supportedCompositeAlpha))
@@ -405,6 +599,12 @@ RETURN_TYPE vulkan_context::init(VkSurfaceKHR surface, window_parameters paramet
         PASS_RESULT(get_queue_family_index(queue_family_index, gpu, surface));
         PASS_RESULT(create_logical_device());
         queue = device.getQueue(queue_family_index, 0);
+
+        vk::SemaphoreTypeCreateInfo timeline_info{ vk::SemaphoreType::eTimeline, 0 };
+        vk::SemaphoreCreateInfo semaphore_info{};
+        semaphore_info.setPNext(&timeline_info);
+        CHECKED_ASSIGN(queue_timeline, device.createSemaphore(semaphore_info));
+
         PASS_RESULT(create_swap_chain());
         PASS_RESULT(create_swapchain_views());
         return RETURN_TYPE();
@@ -428,6 +628,7 @@ RETURN_TYPE vulkan_context::create_framebuffers(vk::RenderPass render_pass) {
 }
 
 RETURN_TYPE vulkan_context::recreate_swapchain(window_parameters parameters, vk::RenderPass render_pass) {
+        trace_scope trace{ "recreate_swapchain" };
         window_size = vk::Extent2D{ parameters.width, parameters.height };
         vsync = parameters.vsync;
 
@@ -460,6 +661,7 @@ RETURN_TYPE vulkan_context::destroy() {
                 destroy_framebuffers();
                 destroy_swapchain_views();
                 device.destroy(swapchain);
+                device.destroy(queue_timeline);
                 device.destroy();
         }
         if (instance) {
@@ -472,5 +674,33 @@ RETURN_TYPE vulkan_context::destroy() {
         return RETURN_TYPE();
 }
 
+void vulkan_context::get_memory_heap_usage(std::vector<vulkan_display::memory_heap_usage>& heaps) const {
+        vk::PhysicalDeviceMemoryProperties properties;
+        vk::PhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+        if (memory_budget_supported) {
+                auto properties_chain = gpu.getMemoryProperties2<
+                        vk::PhysicalDeviceMemoryProperties2, vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+                properties = properties_chain.get<vk::PhysicalDeviceMemoryProperties2>().memoryProperties;
+                budget = properties_chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+        } else {
+                properties = gpu.getMemoryProperties();
+        }
+
+        heaps.assign(properties.memoryHeapCount, {});
+        for (uint32_t i = 0; i < properties.memoryHeapCount; i++) {
+                auto& heap = heaps[i];
+                heap.size = properties.memoryHeaps[i].size;
+                heap.budget = memory_budget_supported ? budget.heapBudget[i] : heap.size;
+                heap.usage = memory_budget_supported ? budget.heapUsage[i] : 0;
+                heap.device_local = static_cast<bool>(properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+        }
+        for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+                auto& type = properties.memoryTypes[i];
+                if (type.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+                        heaps[type.heapIndex].host_visible = true;
+                }
+        }
+}
+
 
 } //vulkan_display_detail
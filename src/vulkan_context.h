@@ -96,6 +96,14 @@ struct window_parameters {
 
 constexpr uint32_t NO_GPU_SELECTED = UINT32_MAX;
 
+struct memory_heap_usage {
+        vk::DeviceSize size = 0;
+        vk::DeviceSize budget = 0;      ///< memory available to the process, heap size without VK_EXT_memory_budget
+        vk::DeviceSize usage = 0;       ///< memory used by the process, 0 without VK_EXT_memory_budget
+        bool device_local = false;
+        bool host_visible = false;      ///< heap has a host visible memory type
+};
+
 vk::ImageViewCreateInfo default_image_view_create_info(vk::Format format);
 
 } // namespace vulkan_display ---------------------------------------------
@@ -109,6 +117,38 @@ using namespace std::literals;
 constexpr uint32_t NO_QUEUE_FAMILY_INDEX_FOUND = UINT32_MAX;
 constexpr uint32_t SWAPCHAIN_IMAGE_OUT_OF_DATE = UINT32_MAX;
 
+/**
+ * Find memory type with requested properties, optional properties are preferred if available
+ */
+RETURN_TYPE get_memory_type(
+        uint32_t& memory_type, uint32_t memory_type_bits,
+        vk::MemoryPropertyFlags requested_properties, vk::MemoryPropertyFlags optional_properties,
+        vk::PhysicalDevice gpu);
+
+/// returns immediately without a wait if the counter of the timeline semaphore already reached the value
+RETURN_TYPE wait_for_timeline_value(vk::Device device, vk::Semaphore timeline, uint64_t value);
+
+/// reached is false if the counter didn't reach the value within timeout_ns
+RETURN_TYPE wait_for_timeline_value(bool& reached, vk::Device device, vk::Semaphore timeline, uint64_t value,
+        uint64_t timeout_ns);
+
+/// bytes per pixel of uncompressed color formats, 0 for other formats
+vk::DeviceSize get_pixel_size(vk::Format format);
+
+/// formats sampled as linear values which were stored sRGB encoded
+bool is_srgb_format(vk::Format format);
+
+/// width and height of blocks of block compressed formats
+constexpr uint32_t compressed_block_extent = 4;
+
+/// bytes per block of BC1, BC3 and BC7 formats, 0 for other formats
+vk::DeviceSize get_compressed_block_size(vk::Format format);
+
+/// buffer memory is host visible, coherent and stays mapped until it is freed
+RETURN_TYPE create_host_buffer(vk::Buffer& buffer, vk::DeviceMemory& memory, void*& ptr,
+        vk::Device device, vk::PhysicalDevice gpu, vk::DeviceSize size, vk::BufferUsageFlags usage,
+        vk::MemoryPropertyFlags optional_properties = {});
+
 struct vulkan_context {
         vk::Instance instance;
 
@@ -121,6 +161,7 @@ struct vulkan_context {
 
         uint32_t queue_family_index = NO_QUEUE_FAMILY_INDEX_FOUND;
         vk::Queue queue;
+        vk::Semaphore queue_timeline; ///< every submission signals a value greater than the previous one
 
         vk::SurfaceKHR surface;
         vk::SwapchainKHR swapchain;
@@ -139,6 +180,11 @@ struct vulkan_context {
 
         vk::Extent2D window_size{ 0, 0 };
         bool vsync = true;
+        bool swapchain_readback = false; ///< swapchain images are created with usage eTransferSrc
+        uint32_t requested_swapchain_image_count = 0; ///< clamped to the surface limits, 0 selects minimal count + 1
+        bool low_latency = false; ///< swapchain has the minimal image count of the surface, overrides the requested count
+        bool memory_budget_supported = false; ///< VK_EXT_memory_budget is enabled
+        bool texture_compression_bc = false; ///< BCn formats can be sampled
 
 private:
 
@@ -194,6 +240,9 @@ public:
         }
 
         RETURN_TYPE recreate_swapchain(window_parameters parameters, vk::RenderPass render_pass);
+
+        /// budget and usage are reported by the driver only if VK_EXT_memory_budget is supported
+        void get_memory_heap_usage(std::vector<vulkan_display::memory_heap_usage>& heaps) const;
 };
 
 }//namespace vulkan_display_detail
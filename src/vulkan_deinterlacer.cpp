@@ -0,0 +1,256 @@
+#include "vulkan_deinterlacer.h"
+
+#include <array>
+#include <vector>
+
+using namespace vulkan_display_detail;
+
+namespace {
+
+struct push_constants {
+        uint32_t mode;
+        uint32_t field_parity;
+        uint32_t second_field;
+        uint32_t history_valid;
+        uint32_t history_index;
+};
+
+constexpr uint32_t workgroup_size = 16;
+
+vk::ImageMemoryBarrier create_barrier(vk::Image image, vk::ImageLayout old_layout, vk::ImageLayout new_layout,
+        vk::AccessFlags old_access, vk::AccessFlags new_access)
+{
+        vk::ImageMemoryBarrier memory_barrier{};
+        memory_barrier
+                .setImage(image)
+                .setOldLayout(old_layout)
+                .setNewLayout(new_layout)
+                .setSrcAccessMask(old_access)
+                .setDstAccessMask(new_access)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        memory_barrier.subresourceRange
+                .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                .setLevelCount(1)
+                .setLayerCount(1);
+        return memory_barrier;
+}
+
+} //namespace -------------------------------------------------------------
+
+namespace vulkan_display_detail {
+
+RETURN_TYPE deinterlacer::init(vk::Device device, vk::DescriptorSetLayout input_layout, vk::ShaderModule shader) {
+        std::array<vk::DescriptorSetLayoutBinding, 2> bindings;
+        bindings[0]
+                .setBinding(0)
+                .setDescriptorCount(1)
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+        bindings[1]
+                .setBinding(1)
+                .setDescriptorCount(static_cast<uint32_t>(history.size()))
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+        vk::DescriptorSetLayoutCreateInfo layout_info{};
+        layout_info
+                .setBindingCount(static_cast<uint32_t>(bindings.size()))
+                .setPBindings(bindings.data());
+        CHECKED_ASSIGN(descriptor_set_layout, device.createDescriptorSetLayout(layout_info));
+
+        vk::DescriptorPoolSize pool_size{ vk::DescriptorType::eStorageImage, 1 + static_cast<uint32_t>(history.size()) };
+        vk::DescriptorPoolCreateInfo pool_info{};
+        pool_info
+                .setPoolSizeCount(1)
+                .setPPoolSizes(&pool_size)
+                .setMaxSets(1);
+        CHECKED_ASSIGN(descriptor_pool, device.createDescriptorPool(pool_info));
+
+        vk::DescriptorSetAllocateInfo allocate_info{};
+        allocate_info
+                .setDescriptorPool(descriptor_pool)
+                .setDescriptorSetCount(1)
+                .setPSetLayouts(&descriptor_set_layout);
+        std::vector<vk::DescriptorSet> sets;
+        CHECKED_ASSIGN(sets, device.allocateDescriptorSets(allocate_info));
+        descriptor_set = sets[0];
+
+        std::array set_layouts{ input_layout, descriptor_set_layout };
+        vk::PushConstantRange push_constant_range{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(push_constants) };
+        vk::PipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info
+                .setSetLayoutCount(static_cast<uint32_t>(set_layouts.size()))
+                .setPSetLayouts(set_layouts.data())
+                .setPushConstantRangeCount(1)
+                .setPPushConstantRanges(&push_constant_range);
+        CHECKED_ASSIGN(pipeline_layout, device.createPipelineLayout(pipeline_layout_info));
+
+        vk::ComputePipelineCreateInfo pipeline_info{};
+        pipeline_info.stage
+                .setModule(shader)
+                .setPName("main")
+                .setStage(vk::ShaderStageFlagBits::eCompute);
+        pipeline_info.setLayout(pipeline_layout);
+        vk::Result result;
+        std::tie(result, pipeline) = device.createComputePipeline(VK_NULL_HANDLE, pipeline_info);
+        CHECK(result, "Deinterlace pipeline cannot be created.");
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE deinterlacer::create_storage_image(storage_image& result, vk::Device device, vk::PhysicalDevice gpu,
+        vk::ImageUsageFlags usage)
+{
+        vk::ImageCreateInfo image_info;
+        image_info
+                .setImageType(vk::ImageType::e2D)
+                .setExtent(vk::Extent3D{ size, 1 })
+                .setMipLevels(1)
+                .setArrayLayers(1)
+                .setFormat(format)
+                .setTiling(vk::ImageTiling::eOptimal)
+                .setInitialLayout(vk::ImageLayout::eUndefined)
+                .setUsage(usage)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setSamples(vk::SampleCountFlagBits::e1);
+        CHECKED_ASSIGN(result.image, device.createImage(image_info));
+
+        vk::MemoryRequirements memory_requirements = device.getImageMemoryRequirements(result.image);
+        uint32_t memory_type = 0;
+        PASS_RESULT(get_memory_type(memory_type, memory_requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags{}, gpu));
+        vk::MemoryAllocateInfo allocate_info{ memory_requirements.size, memory_type };
+        CHECKED_ASSIGN(result.memory, device.allocateMemory(allocate_info));
+        PASS_RESULT(device.bindImageMemory(result.image, result.memory, 0));
+
+        vk::ImageViewCreateInfo view_info = vulkan_display::default_image_view_create_info(format);
+        view_info.setImage(result.image);
+        CHECKED_ASSIGN(result.view, device.createImageView(view_info));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE deinterlacer::create_images(vk::Device device, vk::PhysicalDevice gpu, vk::Extent2D size) {
+        destroy_images(device);
+        this->size = size;
+        PASS_RESULT(create_storage_image(output, device, gpu,
+                vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled));
+        for (auto& image : history) {
+                PASS_RESULT(create_storage_image(image, device, gpu, vk::ImageUsageFlagBits::eStorage));
+        }
+
+        vk::DescriptorImageInfo output_info{ nullptr, output.view, vk::ImageLayout::eGeneral };
+        std::array<vk::DescriptorImageInfo, 2> history_infos{
+                vk::DescriptorImageInfo{ nullptr, history[0].view, vk::ImageLayout::eGeneral },
+                vk::DescriptorImageInfo{ nullptr, history[1].view, vk::ImageLayout::eGeneral } };
+        std::array<vk::WriteDescriptorSet, 2> descriptor_writes;
+        descriptor_writes[0]
+                .setDstSet(descriptor_set)
+                .setDstBinding(0)
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setDescriptorCount(1)
+                .setPImageInfo(&output_info);
+        descriptor_writes[1]
+                .setDstSet(descriptor_set)
+                .setDstBinding(1)
+                .setDescriptorType(vk::DescriptorType::eStorageImage)
+                .setDescriptorCount(static_cast<uint32_t>(history_infos.size()))
+                .setPImageInfo(history_infos.data());
+        device.updateDescriptorSets(descriptor_writes, nullptr);
+        update_desciptor_set = true;
+        return RETURN_TYPE();
+}
+
+void deinterlacer::record(vk::CommandBuffer cmd_buffer, vk::DescriptorSet input_set,
+        vulkan_display::deinterlace_mode mode, uint32_t field_parity, bool second_field)
+{
+        using layout = vk::ImageLayout;
+        using access = vk::AccessFlagBits;
+        using stage = vk::PipelineStageFlagBits;
+
+        // output of the previous frame is discarded, but it can be still sampled by the previous command buffer
+        auto output_barrier = create_barrier(output.image, layout::eUndefined, layout::eGeneral,
+                access::eShaderRead, access::eShaderWrite);
+        cmd_buffer.pipelineBarrier(stage::eFragmentShader, stage::eComputeShader,
+                vk::DependencyFlags{}, nullptr, nullptr, output_barrier);
+        if (!images_initialized) {
+                images_initialized = true;
+                std::array history_barriers{
+                        create_barrier(history[0].image, layout::eUndefined, layout::eGeneral, {}, access::eShaderWrite),
+                        create_barrier(history[1].image, layout::eUndefined, layout::eGeneral, {}, access::eShaderWrite) };
+                cmd_buffer.pipelineBarrier(stage::eTopOfPipe, stage::eComputeShader,
+                        vk::DependencyFlags{}, nullptr, nullptr, history_barriers);
+        } else {
+                // history written by the previous dispatch is read, the other history image is overwritten
+                vk::MemoryBarrier history_barrier{ access::eShaderWrite, access::eShaderRead | access::eShaderWrite };
+                cmd_buffer.pipelineBarrier(stage::eComputeShader, stage::eComputeShader,
+                        vk::DependencyFlags{}, history_barrier, nullptr, nullptr);
+        }
+
+        push_constants constants{ static_cast<uint32_t>(mode), field_parity, second_field ? 1u : 0u,
+                history_valid ? 1u : 0u, history_index };
+        cmd_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        std::array sets{ input_set, descriptor_set };
+        cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipeline_layout, 0, sets, nullptr);
+        cmd_buffer.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(constants), &constants);
+        cmd_buffer.dispatch((size.width + workgroup_size - 1) / workgroup_size,
+                (size.height + workgroup_size - 1) / workgroup_size, 1);
+
+        auto sample_barrier = create_barrier(output.image, layout::eGeneral, layout::eShaderReadOnlyOptimal,
+                access::eShaderWrite, access::eShaderRead);
+        cmd_buffer.pipelineBarrier(stage::eComputeShader, stage::eFragmentShader,
+                vk::DependencyFlags{}, nullptr, nullptr, sample_barrier);
+
+        if (second_field) {
+                history_valid = true;
+                history_index = 1 - history_index;
+        }
+}
+
+RETURN_TYPE deinterlacer::update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler) {
+        if (update_desciptor_set) {
+                update_desciptor_set = false;
+                vk::DescriptorImageInfo description_image_info;
+                description_image_info
+                        .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+                        .setSampler(sampler)
+                        .setImageView(output.view);
+
+                vk::WriteDescriptorSet descriptor_writes{};
+                descriptor_writes
+                        .setDstBinding(1)
+                        .setDstArrayElement(0)
+                        .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                        .setPImageInfo(&description_image_info)
+                        .setDescriptorCount(1)
+                        .setDstSet(descriptor_set);
+
+                device.updateDescriptorSets(descriptor_writes, nullptr);
+        }
+        return RETURN_TYPE();
+}
+
+void deinterlacer::destroy_images(vk::Device device) {
+        for (auto* image : { &output, &history[0], &history[1] }) {
+                device.destroy(image->view);
+                device.destroy(image->image);
+                device.freeMemory(image->memory);
+                *image = {};
+        }
+        size = vk::Extent2D{};
+        images_initialized = false;
+        history_valid = false;
+        history_index = 0;
+}
+
+void deinterlacer::destroy(vk::Device device) {
+        destroy_images(device);
+        device.destroy(pipeline);
+        device.destroy(pipeline_layout);
+        device.destroy(descriptor_pool);
+        device.destroy(descriptor_set_layout);
+        pipeline = nullptr;
+        pipeline_layout = nullptr;
+        descriptor_pool = nullptr;
+        descriptor_set_layout = nullptr;
+}
+
+} // vulkan_display_detail
@@ -0,0 +1,83 @@
+#pragma once
+#include "vulkan_context.h"
+
+#include <array>
+
+namespace vulkan_display {
+
+/**
+ * Weave displays both fields of the frame at once, bob and motion adaptive modes
+ * display every field as a separate frame, so 25/30 interlaced frames are presented as 50/60 frames per second
+ */
+enum class deinterlace_mode : uint32_t {
+        weave,
+        bob,            ///< missing lines are interpolated from the lines of the field
+        motion_adaptive,///< static areas keep the lines of the other field, moving areas are interpolated
+};
+
+} // vulkan_display
+
+namespace vulkan_display_detail {
+
+/**
+ * Deinterlaces transfer images by a compute shader into a device local image, which is sampled instead of them.
+ * The last frame is copied into a history image, because transfer images are given back to producers.
+ */
+class deinterlacer {
+        struct storage_image {
+                vk::DeviceMemory memory;
+                vk::Image image;
+                vk::ImageView view;
+        };
+
+        vk::DescriptorSetLayout descriptor_set_layout;
+        vk::DescriptorPool descriptor_pool;
+        vk::DescriptorSet descriptor_set;
+        vk::PipelineLayout pipeline_layout;
+        vk::Pipeline pipeline;
+
+        storage_image output;
+        std::array<storage_image, 2> history{};
+        vk::Extent2D size{};
+        uint32_t history_index = 0;
+        bool images_initialized = false;
+        bool history_valid = false;
+
+        RETURN_TYPE create_storage_image(storage_image& result, vk::Device device, vk::PhysicalDevice gpu,
+                vk::ImageUsageFlags usage);
+
+public:
+        /// half float output keeps the values linear, sRGB formats usually cannot be used for storage images
+        static constexpr vk::Format format = vk::Format::eR16G16B16A16Sfloat;
+
+        bool update_desciptor_set = true;
+
+        /// input_layout is the layout of descriptor sets of transfer images, the image is bound to its binding 1
+        RETURN_TYPE init(vk::Device device, vk::DescriptorSetLayout input_layout, vk::ShaderModule shader);
+
+        bool is_initialized() const {
+                return static_cast<bool>(pipeline);
+        }
+
+        vk::Extent2D get_size() const {
+                return size;
+        }
+
+        /// previously submitted command buffers cannot use the images anymore
+        RETURN_TYPE create_images(vk::Device device, vk::PhysicalDevice gpu, vk::Extent2D size);
+
+        /**
+         * Transfer image has to be readable by the compute shader.
+         * Output image is in layout eShaderReadOnlyOptimal after the commands are executed.
+         */
+        void record(vk::CommandBuffer cmd_buffer, vk::DescriptorSet input_set, vulkan_display::deinterlace_mode mode,
+                uint32_t field_parity, bool second_field);
+
+        RETURN_TYPE update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler);
+
+        void destroy_images(vk::Device device);
+
+        void destroy(vk::Device device);
+};
+
+} // vulkan_display_detail
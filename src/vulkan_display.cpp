@@ -1,4 +1,5 @@
 #include "vulkan_display.h"
+#include "vulkan_display_detail.h"
 
 #include <algorithm>
 #include <cmath>
@@ -35,13 +36,110 @@ RETURN_TYPE create_shader(vk::ShaderModule& shader,
         return RETURN_TYPE();
 }
 
+/// crop rectangle clamped to the image, zero extent selects the whole image
+vk::Rect2D get_crop_rect(vk::Rect2D crop, vk::Extent2D image_size) {
+        uint32_t x = std::min(static_cast<uint32_t>(std::max(crop.offset.x, 0)), image_size.width);
+        uint32_t y = std::min(static_cast<uint32_t>(std::max(crop.offset.y, 0)), image_size.height);
+        vk::Extent2D extent{ std::min(crop.extent.width, image_size.width - x), std::min(crop.extent.height, image_size.height - y) };
+        if (extent.width * extent.height == 0) {
+                return vk::Rect2D{ { 0, 0 }, image_size };
+        }
+        return vk::Rect2D{ { static_cast<int32_t>(x), static_cast<int32_t>(y) }, extent };
+}
+
+vk::Extent2D get_transformed_size(vk::Extent2D image_size, const vulkan_display::image_transform& transform) {
+        vk::Extent2D size = get_crop_rect(transform.crop, image_size).extent;
+        using rotation = vulkan_display::image_rotation;
+        if (transform.rotation == rotation::clockwise_90 || transform.rotation == rotation::clockwise_270) {
+                std::swap(size.width, size.height);
+        }
+        return size;
+}
+
+/// affine map from the coordinates in the render area to the texture coordinates of the transformed image
+void set_uv_transform(fragment_push_constants& constants, vk::Extent2D image_size,
+        const vulkan_display::image_transform& transform)
+{
+        // coordinates flipped back, u' = flip_u * u + offset_u
+        float flip_u = transform.flip_horizontal ? -1.f : 1.f;
+        float offset_u = transform.flip_horizontal ? 1.f : 0.f;
+        float flip_v = transform.flip_vertical ? -1.f : 1.f;
+        float offset_v = transform.flip_vertical ? 1.f : 0.f;
+
+        // rows (u, v, 1) of the coordinates in the cropped image before the clockwise rotation
+        std::array<float, 3> s{};
+        std::array<float, 3> t{};
+        using rotation = vulkan_display::image_rotation;
+        switch (transform.rotation) {
+        case rotation::none:
+                s = { flip_u, 0.f, offset_u };
+                t = { 0.f, flip_v, offset_v };
+                break;
+        case rotation::clockwise_90:
+                s = { 0.f, flip_v, offset_v };
+                t = { -flip_u, 0.f, 1.f - offset_u };
+                break;
+        case rotation::clockwise_180:
+                s = { -flip_u, 0.f, 1.f - offset_u };
+                t = { 0.f, -flip_v, 1.f - offset_v };
+                break;
+        case rotation::clockwise_270:
+                s = { 0.f, -flip_v, 1.f - offset_v };
+                t = { flip_u, 0.f, offset_u };
+                break;
+        }
+
+        vk::Rect2D crop = get_crop_rect(transform.crop, image_size);
+        float scale_x = static_cast<float>(crop.extent.width) / image_size.width;
+        float scale_y = static_cast<float>(crop.extent.height) / image_size.height;
+        constants.uv_transform_x = { s[0] * scale_x, s[1] * scale_x,
+                s[2] * scale_x + static_cast<float>(crop.offset.x) / image_size.width };
+        constants.uv_transform_y = { t[0] * scale_y, t[1] * scale_y,
+                t[2] * scale_y + static_cast<float>(crop.offset.y) / image_size.height };
+}
+
+/// tiles which don't fit into the window have zero extent
+vk::Rect2D get_mosaic_tile_rect(const vulkan_display::mosaic_layout& layout, uint32_t tile, vk::Extent2D window_size) {
+        uint32_t column = tile % layout.columns;
+        uint32_t row = tile / layout.columns;
+        auto get_tile_extent = [&layout](uint32_t window_extent, uint32_t count) {
+                uint32_t spacing = layout.spacing * (count + 1);
+                return window_extent > spacing ? (window_extent - spacing) / count : 0;
+        };
+        uint32_t width = get_tile_extent(window_size.width, layout.columns);
+        uint32_t height = get_tile_extent(window_size.height, layout.rows);
+        vk::Offset2D offset{
+                static_cast<int32_t>(layout.spacing + column * (width + layout.spacing)),
+                static_cast<int32_t>(layout.spacing + row * (height + layout.spacing)) };
+        return vk::Rect2D{ offset, { width, height } };
+}
+
+} //namespace -------------------------------------------------------------
+
+
+namespace vulkan_display_detail {
+
 RETURN_TYPE update_render_area_viewport_scissor(render_area& render_area, vk::Viewport& viewport, vk::Rect2D& scissor, 
-        vk::Extent2D window_size, vk::Extent2D transfer_image_size) {
+        vk::Extent2D window_size, vk::Extent2D image_size, const vulkan_display::image_transform& transform,
+        bool integer_scaling)
+{
+        // aspect ratio and integer scale are given by the displayed part of the image
+        vk::Extent2D transfer_image_size = get_transformed_size(image_size, transform);
 
         double wnd_aspect = static_cast<double>(window_size.width) / window_size.height;
         double img_aspect = static_cast<double>(transfer_image_size.width) / transfer_image_size.height;
 
-        if (wnd_aspect > img_aspect) {
+        uint32_t integer_scale = 0;
+        if (integer_scaling && transfer_image_size.width * transfer_image_size.height != 0) {
+                integer_scale = std::min(window_size.width / transfer_image_size.width,
+                        window_size.height / transfer_image_size.height);
+        }
+        if (integer_scale > 0) {
+                render_area.width = transfer_image_size.width * integer_scale;
+                render_area.height = transfer_image_size.height * integer_scale;
+                render_area.x = (window_size.width - render_area.width) / 2;
+                render_area.y = (window_size.height - render_area.height) / 2;
+        } else if (wnd_aspect > img_aspect) {
                 render_area.height = window_size.height;
                 render_area.width = static_cast<uint32_t>(std::round(window_size.height * img_aspect));
                 render_area.x = (window_size.width - render_area.width) / 2;
@@ -66,33 +164,47 @@ RETURN_TYPE update_render_area_viewport_scissor(render_area& render_area, vk::Vi
         return RETURN_TYPE();
 }
 
-transfer_image& acquire_transfer_image(concurrent_queue<transfer_image*>& available_img_queue,
-        concurrent_queue<vulkan_display::image>& filled_img_queue, unsigned filled_img_max_count)
+transfer_image* acquire_transfer_image(concurrent_queue<transfer_image*>& available_img_queue,
+        concurrent_queue<vulkan_display::image>& filled_img_queue, unsigned filled_img_max_count,
+        vulkan_display::image_description description, 
+        std::optional<std::chrono::steady_clock::time_point> deadline, bool& dropped)
 {
-        // first try available_img_queue
-        auto maybe_transfer_image = available_img_queue.try_pop();
-        if (maybe_transfer_image.has_value()) {
-                assert(*maybe_transfer_image);
-                return **maybe_transfer_image;
+        dropped = false;
+        // first try available_img_queue, image of the same description doesn't have to be recreated
+        {
+                auto [lock, deque] = available_img_queue.get_underlying_deque();
+                auto it = std::find_if(deque.begin(), deque.end(),
+                        [&description](transfer_image* image) { return image->description == description; });
+                if (it == deque.end()) {
+                        it = deque.begin();
+                }
+                if (it != deque.end()) {
+                        transfer_image* result = *it;
+                        assert(result);
+                        deque.erase(it);
+                        return result;
+                }
         }
         // if available_img_queue is empty and filled_img_queue is almost full,
         // take frame from filled_img_queue
         {
                 auto [lock, deque] = filled_img_queue.get_underlying_deque();
-                while (deque.size() > filled_img_max_count) {
-                        vulkan_display::image front = deque.front();
+                if (deque.size() > filled_img_max_count) {
+                        transfer_image* result = deque.front().get_transfer_image();
+                        assert(result);
                         deque.pop_front();
-                        auto* front_image_ptr = front.get_transfer_image();
-                        if (front_image_ptr) {
-                                return *front_image_ptr;
-                        }
+                        dropped = true;
+                        return result;
                 }
         }
         //else wait for frame from available_img_queue
-        return *available_img_queue.pop();
+        if (!deadline) {
+                return available_img_queue.pop();
+        }
+        return available_img_queue.pop_until(*deadline).value_or(nullptr);
 }
 
-} //namespace -------------------------------------------------------------
+} // vulkan_display_detail
 
 
 namespace vulkan_display {
@@ -105,6 +217,9 @@ RETURN_TYPE vulkan_display::create_texture_sampler() {
                 .setAddressModeW(vk::SamplerAddressMode::eClampToBorder)
                 .setMagFilter(vk::Filter::eLinear)
                 .setMinFilter(vk::Filter::eLinear)
+                .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+                .setMinLod(0.f)
+                .setMaxLod(VK_LOD_CLAMP_NONE)
                 .setAnisotropyEnable(false)
                 .setUnnormalizedCoordinates(false);
         CHECKED_ASSIGN(sampler, device.createSampler(sampler_info));
@@ -167,7 +282,8 @@ RETURN_TYPE vulkan_display::create_descriptor_set_layout() {
                 .setBinding(1)
                 .setDescriptorCount(1)
                 .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
-                .setStageFlags(vk::ShaderStageFlagBits::eFragment)
+                // the deinterlacer reads transfer images through their descriptor sets
+                .setStageFlags(vk::ShaderStageFlagBits::eFragment | vk::ShaderStageFlagBits::eCompute)
                 .setPImmutableSamplers(&sampler);
 
         vk::DescriptorSetLayoutCreateInfo descriptor_set_layout_info{};
@@ -188,17 +304,24 @@ RETURN_TYPE vulkan_display::create_graphics_pipeline() {
         vk::PushConstantRange push_constants;
         push_constants
                 .setOffset(0)
-                .setSize(sizeof(render_area))
+                .setSize(sizeof(fragment_push_constants))
                 .setStageFlags(vk::ShaderStageFlagBits::eFragment);
+        // set 1 holds the color LUT
+        std::array set_layouts{ descriptor_set_layout, color_lut.get_descriptor_set_layout() };
         pipeline_layout_info
                 .setPushConstantRangeCount(1)
                 .setPPushConstantRanges(&push_constants)
-                .setSetLayoutCount(1)
-                .setPSetLayouts(&descriptor_set_layout);
+                .setSetLayoutCount(static_cast<uint32_t>(set_layouts.size()))
+                .setPSetLayouts(set_layouts.data());
         CHECKED_ASSIGN(pipeline_layout, device.createPipelineLayout(pipeline_layout_info));
 
         vk::GraphicsPipelineCreateInfo pipeline_info{};
 
+        // scaling filter is selected by the specialization constant 0 in the fragment shader
+        uint32_t filter_constant = 0;
+        vk::SpecializationMapEntry specialization_entry{ 0, 0, sizeof(filter_constant) };
+        vk::SpecializationInfo specialization_info{ 1, &specialization_entry, sizeof(filter_constant), &filter_constant };
+
         std::array<vk::PipelineShaderStageCreateInfo, 2> shader_stages_infos;
         shader_stages_infos[0]
                 .setModule(vertex_shader)
@@ -207,7 +330,8 @@ RETURN_TYPE vulkan_display::create_graphics_pipeline() {
         shader_stages_infos[1]
                 .setModule(fragment_shader)
                 .setPName("main")
-                .setStage(vk::ShaderStageFlagBits::eFragment);
+                .setStage(vk::ShaderStageFlagBits::eFragment)
+                .setPSpecializationInfo(&specialization_info);
         pipeline_info
                 .setStageCount(static_cast<uint32_t>(shader_stages_infos.size()))
                 .setPStages(shader_stages_infos.data());
@@ -259,23 +383,26 @@ RETURN_TYPE vulkan_display::create_graphics_pipeline() {
                 .setLayout(pipeline_layout)
                 .setRenderPass(render_pass);
 
-        vk::Result result;
-        std::tie(result, pipeline) = device.createGraphicsPipeline(VK_NULL_HANDLE, pipeline_info);
-        CHECK(result, "Pipeline cannot be created.");
-        return RETURN_TYPE();
-}
-
-RETURN_TYPE vulkan_display::create_image_semaphores()
-{
-        vk::SemaphoreCreateInfo semaphore_info;
-
-        image_semaphores.resize(transfer_image_count);
-
-        for (auto& image_semaphores : image_semaphores) {
-                CHECKED_ASSIGN(image_semaphores.image_acquired, device.createSemaphore(semaphore_info));
-                CHECKED_ASSIGN(image_semaphores.image_rendered, device.createSemaphore(semaphore_info));
+        for (size_t i = 0; i < scaling_filter_count; i++) {
+                filter_constant = static_cast<uint32_t>(i);
+                vk::Result result;
+                std::tie(result, pipelines[i]) = device.createGraphicsPipeline(VK_NULL_HANDLE, pipeline_info);
+                CHECK(result, "Pipeline cannot be created.");
         }
 
+        // overlays are blended over the video with bilinear filter
+        filter_constant = static_cast<uint32_t>(scaling_filter::bilinear);
+        color_blend_attachment
+                .setBlendEnable(true)
+                .setSrcColorBlendFactor(vk::BlendFactor::eSrcAlpha)
+                .setDstColorBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+                .setColorBlendOp(vk::BlendOp::eAdd)
+                .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+                .setDstAlphaBlendFactor(vk::BlendFactor::eOneMinusSrcAlpha)
+                .setAlphaBlendOp(vk::BlendOp::eAdd);
+        vk::Result result;
+        std::tie(result, overlay_pipeline) = device.createGraphicsPipeline(VK_NULL_HANDLE, pipeline_info);
+        CHECK(result, "Overlay pipeline cannot be created.");
         return RETURN_TYPE();
 }
 
@@ -289,31 +416,86 @@ RETURN_TYPE vulkan_display::create_command_pool() {
         return RETURN_TYPE();
 }
 
-RETURN_TYPE vulkan_display::create_command_buffers() {
+RETURN_TYPE vulkan_display::create_frame_slots(frame_slot* slots, uint32_t slot_count) {
         vk::CommandBufferAllocateInfo allocate_info{};
         allocate_info
                 .setCommandPool(command_pool)
                 .setLevel(vk::CommandBufferLevel::ePrimary)
-                .setCommandBufferCount(static_cast<uint32_t>(transfer_image_count));
+                .setCommandBufferCount(slot_count);
+        std::vector<vk::CommandBuffer> command_buffers;
         CHECKED_ASSIGN(command_buffers, device.allocateCommandBuffers(allocate_info));
+
+        vk::SemaphoreCreateInfo semaphore_info;
+        for (uint32_t i = 0; i < slot_count; i++) {
+                auto& slot = slots[i];
+                slot.command_buffer = command_buffers[i];
+                CHECKED_ASSIGN(slot.image_acquired, device.createSemaphore(semaphore_info));
+                CHECKED_ASSIGN(slot.image_rendered, device.createSemaphore(semaphore_info));
+        }
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::create_timestamp_pool() {
+        auto queue_families = context.gpu.getQueueFamilyProperties();
+        if (queue_families[context.queue_family_index].timestampValidBits == 0) {
+                // gpu time is not measured
+                return RETURN_TYPE();
+        }
+        timestamp_period_ms = context.gpu.getProperties().limits.timestampPeriod / 1e6;
+
+        vk::QueryPoolCreateInfo pool_info{};
+        pool_info
+                .setQueryType(vk::QueryType::eTimestamp)
+                .setQueryCount(2 * static_cast<uint32_t>(frame_slots.size()));
+        CHECKED_ASSIGN(timestamp_pool, device.createQueryPool(pool_info));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::collect_gpu_time(uint32_t slot_id) {
+        auto& slot = frame_slots[slot_id].timestamp;
+        if (!timestamp_pool || !slot.written) {
+                return RETURN_TYPE();
+        }
+        slot.written = false;
+
+        std::array<uint64_t, 2> timestamps{};
+        auto result = device.getQueryPoolResults(timestamp_pool, 2 * slot_id, 2,
+                sizeof(timestamps), timestamps.data(), sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if (result == vk::Result::eNotReady) {
+                return RETURN_TYPE();
+        }
+        CHECK(result, "Timestamp query results cannot be read.");
+
+        double time_ms = static_cast<double>(timestamps[1] - timestamps[0]) * timestamp_period_ms;
+        std::scoped_lock lock(statistics_mutex);
+        auto& statistics = slot.lut_applied ? lut_frame_statistics.gpu_time :
+                slot.mipmapped ? mipmap_frame_statistics.gpu_time :
+                filter_statistics[static_cast<size_t>(slot.filter)];
+        statistics.frame_count++;
+        statistics.total_ms += time_ms;
+        statistics.last_ms = time_ms;
         return RETURN_TYPE();
 }
 
 RETURN_TYPE vulkan_display::allocate_description_sets() {
         assert(transfer_image_count != 0);
         assert(descriptor_set_layout);
+        // one descriptor set for every transfer image, one for the mipmap image, one for the deinterlaced image,
+        // two for every overlay and one for every image of mosaic streams
+        uint32_t set_count = transfer_image_count + 2 + 2 * max_overlay_count +
+                max_mosaic_stream_count * max_mosaic_stream_image_count;
         vk::DescriptorPoolSize descriptor_sizes{};
         descriptor_sizes
                 .setType(vk::DescriptorType::eCombinedImageSampler)
-                .setDescriptorCount(transfer_image_count);
+                .setDescriptorCount(set_count);
         vk::DescriptorPoolCreateInfo pool_info{};
         pool_info
                 .setPoolSizeCount(1)
                 .setPPoolSizes(&descriptor_sizes)
-                .setMaxSets(transfer_image_count);
+                .setMaxSets(set_count);
         CHECKED_ASSIGN(descriptor_pool, device.createDescriptorPool(pool_info));
 
-        std::vector<vk::DescriptorSetLayout> layouts(transfer_image_count, descriptor_set_layout);
+        std::vector<vk::DescriptorSetLayout> layouts(set_count, descriptor_set_layout);
 
         vk::DescriptorSetAllocateInfo allocate_info;
         allocate_info
@@ -322,18 +504,47 @@ RETURN_TYPE vulkan_display::allocate_description_sets() {
                 .setPSetLayouts(layouts.data());
 
         CHECKED_ASSIGN(descriptor_sets, device.allocateDescriptorSets(allocate_info));
+        for (auto it = overlays.rbegin(); it != overlays.rend(); ++it) {
+                it->descriptor_sets[1] = descriptor_sets.back();
+                descriptor_sets.pop_back();
+                it->descriptor_sets[0] = descriptor_sets.back();
+                descriptor_sets.pop_back();
+        }
+        for (auto& stream : mosaic_streams) {
+                for (auto& descriptor_set : stream.descriptor_sets) {
+                        descriptor_set = descriptor_sets.back();
+                        descriptor_sets.pop_back();
+                }
+        }
+        mipmap_descriptor_set = descriptor_sets.back();
+        descriptor_sets.pop_back();
+        deinterlace_descriptor_set = descriptor_sets.back();
+        descriptor_sets.pop_back();
 
         return RETURN_TYPE();
 }
 
-RETURN_TYPE vulkan_display::init(VkSurfaceKHR surface, uint32_t transfer_image_count,
+RETURN_TYPE vulkan_display::init(VkSurfaceKHR surface, display_parameters parameters,
         window_changed_callback* window, uint32_t gpu_index) {
         // Order of following calls is important
         assert(surface);
+        CHECK(parameters.transfer_image_count > 0, "At least one transfer image is needed.");
+        CHECK(parameters.frames_in_flight > 0, "At least one frame in flight is needed.");
         this->window = window;
-        this->transfer_image_count = transfer_image_count;
-        this->filled_img_max_count = (transfer_image_count + 1) / 2;
+        uint32_t initial_count = parameters.transfer_image_count;
+        uint32_t max_count = std::max(parameters.max_transfer_image_count, initial_count);
+        uint32_t min_count = parameters.max_transfer_image_count == 0 ? initial_count :
+                std::clamp(parameters.min_transfer_image_count, 1u, initial_count);
+        // the producer would wait for the only image, which is kept by the display thread
+        CHECK(!keep_last_image || min_count >= 2, "Keeping the last image needs at least two transfer images.");
+        adaptive_transfer_pool = min_count < max_count;
+        pool_sizer.init(min_count, max_count, initial_count);
+        this->transfer_image_count = max_count;
+        this->min_transfer_image_count = min_count;
+        this->filled_img_max_count = (initial_count + 1) / 2;
+        image_cache.init(parameters.cached_image_count, parameters.transfer_memory_limit);
         auto window_parameters = window->get_window_parameters();
+        context.requested_swapchain_image_count = parameters.swapchain_image_count;
         PASS_RESULT(context.init(surface, window_parameters, gpu_index));
         device = context.device;
         PASS_RESULT(create_shader(vertex_shader, "shaders/vert.spv", device));
@@ -341,43 +552,97 @@ RETURN_TYPE vulkan_display::init(VkSurfaceKHR surface, uint32_t transfer_image_c
         PASS_RESULT(create_render_pass());
         context.create_framebuffers(render_pass);
         PASS_RESULT(create_texture_sampler());
+        PASS_RESULT(color_lut.init(device));
         PASS_RESULT(create_graphics_pipeline());
         PASS_RESULT(create_command_pool());
-        PASS_RESULT(create_command_buffers());
-        PASS_RESULT(create_image_semaphores());
+        frame_slots.resize(parameters.frames_in_flight);
+        PASS_RESULT(create_frame_slots(frame_slots.data(), parameters.frames_in_flight));
+        PASS_RESULT(create_timestamp_pool());
         PASS_RESULT(allocate_description_sets());
 
         transfer_images.reserve(transfer_image_count);
         auto[lock, deque] = available_img_queue.get_underlying_deque();
         for (uint32_t i = 0; i < transfer_image_count; i++) {
                 transfer_images.emplace_back(device, i);
+                if (i >= initial_count) {
+                        // images over the initial count are added by the adaptive pool when needed
+                        retired_images.push_back(&transfer_images.back());
+                        continue;
+                }
                 //push_front - discarded images should be pushed at the front,
-                // because they will not wait in the function device.waitForFences
+                // because they will not wait for their frame in acquire_image
                 deque.push_front(&transfer_images.back());
         }
+
+        // overlay images get ids after the transfer images
+        uint32_t overlay_image_id = transfer_image_count;
+        for (auto& overlay : overlays) {
+                for (auto& image : overlay.images) {
+                        PASS_RESULT(image.init(device, overlay_image_id++));
+                }
+        }
+        overlay_draws.reserve(max_overlay_count);
+        // mosaic images get ids after the overlay images
+        uint32_t mosaic_image_id = overlay_image_id;
+        for (auto& stream : mosaic_streams) {
+                for (auto& image : stream.images) {
+                        PASS_RESULT(image.init(device, mosaic_image_id++));
+                }
+        }
+        mosaic_draws.reserve(max_mosaic_stream_count);
         return RETURN_TYPE();
 }
 
 RETURN_TYPE vulkan_display::destroy() {
         if (!destroyed) {
                 destroyed = true;
+                preprocess_pool.stop();
                 if (device) {
                         PASS_RESULT(device.waitIdle());
+                        readback.destroy();
                         device.destroy(descriptor_pool);
 
+                        last_image = nullptr;
+                        pending_second_field = nullptr;
                         for (auto& image : transfer_images) {
                                 PASS_RESULT(image.destroy(device));
                         }
+                        image_cache.destroy(device);
+                        mipmap_image.destroy(device);
+                        deinterlacer.destroy(device);
+                        device.destroy(deinterlace_shader);
+                        tiled_image.destroy(device);
+                        for (auto& frame : tiled_frames) {
+                                device.destroy(frame.image_acquired);
+                                device.destroy(frame.image_rendered);
+                        }
+                        device.destroy(tile_fragment_shader);
+                        device.destroy(tile_vertex_shader);
+                        for (auto& overlay : overlays) {
+                                for (auto& image : overlay.images) {
+                                        PASS_RESULT(image.destroy(device));
+                                }
+                        }
+                        for (auto& stream : mosaic_streams) {
+                                for (auto& image : stream.images) {
+                                        PASS_RESULT(image.destroy(device));
+                                }
+                        }
                         device.destroy(command_pool);
                         device.destroy(render_pass);
                         device.destroy(fragment_shader);
                         device.destroy(vertex_shader);
-                        for (auto& image_semaphores : image_semaphores) {
-                                device.destroy(image_semaphores.image_acquired);
-                                device.destroy(image_semaphores.image_rendered);
+                        for (auto& slot : frame_slots) {
+                                device.destroy(slot.image_acquired);
+                                device.destroy(slot.image_rendered);
                         }
-                        device.destroy(pipeline);
+                        device.destroy(timestamp_pool);
+                        for (auto& pipeline : pipelines) {
+                                device.destroy(pipeline);
+                        }
+                        device.destroy(overlay_pipeline);
                         device.destroy(pipeline_layout);
+                        color_lut.destroy(device);
                         device.destroy(descriptor_set_layout);
                         device.destroy(sampler);
                 }
@@ -386,18 +651,230 @@ RETURN_TYPE vulkan_display::destroy() {
         return RETURN_TYPE();
 }
 
-RETURN_TYPE vulkan_display::record_graphics_commands(transfer_image& transfer_image, uint32_t swapchain_image_id) {
-        vk::CommandBuffer& cmd_buffer = command_buffers[transfer_image.id];
+RETURN_TYPE vulkan_display::update_mipmap_image(bool& use_mipmaps, image_description description) {
+        use_mipmaps = false;
+        if (!mipmapping_enabled || render_area.width * render_area.height == 0) {
+                return RETURN_TYPE();
+        }
+        // render area is fitted to the cropped and rotated image
+        vk::Extent2D displayed_size = get_transformed_size(description.size, render_area_transform);
+        double downscale_ratio = std::max(
+                static_cast<double>(displayed_size.width) / render_area.width,
+                static_cast<double>(displayed_size.height) / render_area.height);
+        if (downscale_ratio <= mipmap_downscale_threshold || 
+                !mipmap_image::is_format_supported(context.gpu, description.format))
+        {
+                return RETURN_TYPE();
+        }
+
+        uint32_t mip_levels = mipmap_image::get_mip_level_count(description.size, downscale_ratio);
+        if (mipmap_image.description != description || mipmap_image.mip_levels != mip_levels) {
+                // mipmap image can be used by previously submitted command buffers
+                PASS_RESULT(device.waitIdle());
+                PASS_RESULT(mipmap_image.create(device, context.gpu, description, mip_levels));
+        }
+        PASS_RESULT(mipmap_image.update_description_set(device, mipmap_descriptor_set, sampler));
+        use_mipmaps = true;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::update_deinterlacer(bool& use_deinterlacer, const transfer_image& transfer_image) {
+        use_deinterlacer = is_deinterlaced(transfer_image);
+        if (!use_deinterlacer) {
+                return RETURN_TYPE();
+        }
+        if (!deinterlacer.is_initialized()) {
+                // shader is loaded only by applications displaying interlaced images
+                PASS_RESULT(create_shader(deinterlace_shader, "shaders/deinterlace.spv", device));
+                PASS_RESULT(deinterlacer.init(device, descriptor_set_layout, deinterlace_shader));
+        }
+        if (deinterlacer.get_size() != transfer_image.description.size) {
+                // deinterlaced image can be used by previously submitted command buffers
+                PASS_RESULT(device.waitIdle());
+                PASS_RESULT(deinterlacer.create_images(device, context.gpu, transfer_image.description.size));
+        }
+        PASS_RESULT(deinterlacer.update_description_set(device, deinterlace_descriptor_set, sampler));
+        return RETURN_TYPE();
+}
+
+void vulkan_display::prepare_overlays(vk::CommandBuffer cmd_buffer, uint64_t frame_number) {
+        overlay_draws.clear();
+        std::scoped_lock lock(overlay_mutex);
+        for (auto& overlay : overlays) {
+                if (!overlay.created || !overlay.front_filled || !overlay.parameters.visible) {
+                        continue;
+                }
+                auto& image = overlay.images[overlay.front];
+                if (overlay.front_changed) {
+                        overlay.front_changed = false;
+                        // overlay images stay in the general layout, so the host can write to them again
+                        auto memory_barrier = image.create_memory_barrier(
+                                vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+                        memory_barrier.setSrcAccessMask(vk::AccessFlagBits::eHostWrite);
+                        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eFragmentShader,
+                                vk::DependencyFlags{}, nullptr, nullptr, memory_barrier);
+                }
+                image.update_description_set(device, overlay.descriptor_sets[overlay.front], sampler, vk::ImageLayout::eGeneral);
+                overlay.last_used_frame[overlay.front] = frame_number;
+                overlay_draws.push_back({ overlay.descriptor_sets[overlay.front], overlay.parameters });
+        }
+        std::stable_sort(overlay_draws.begin(), overlay_draws.end(), [](auto& a, auto& b) {
+                return a.parameters.z_order < b.parameters.z_order;
+        });
+}
+
+void vulkan_display::record_overlay_draws(vk::CommandBuffer cmd_buffer) {
+        if (overlay_draws.empty()) {
+                return;
+        }
+        cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, overlay_pipeline);
+        for (auto& draw : overlay_draws) {
+                auto& parameters = draw.parameters;
+                fragment_push_constants constants{};
+                constants.alpha = parameters.alpha;
+                auto& area = constants.area;
+                area.x = render_area.x + static_cast<uint32_t>(std::round(std::max(parameters.x, 0.f) * render_area.width));
+                area.y = render_area.y + static_cast<uint32_t>(std::round(std::max(parameters.y, 0.f) * render_area.height));
+                area.width = static_cast<uint32_t>(std::round(std::max(parameters.width, 0.f) * render_area.width));
+                area.height = static_cast<uint32_t>(std::round(std::max(parameters.height, 0.f) * render_area.height));
+
+                // overlays are clipped by the video render area
+                uint32_t right = std::min(area.x + area.width, render_area.x + render_area.width);
+                uint32_t bottom = std::min(area.y + area.height, render_area.y + render_area.height);
+                if (area.width * area.height == 0 || right <= area.x || bottom <= area.y) {
+                        continue;
+                }
+                vk::Rect2D overlay_scissor{ 
+                        { static_cast<int32_t>(area.x), static_cast<int32_t>(area.y) }, 
+                        { right - area.x, bottom - area.y } };
+                vk::Viewport overlay_viewport{ static_cast<float>(area.x), static_cast<float>(area.y),
+                        static_cast<float>(area.width), static_cast<float>(area.height), 0.f, 1.f };
+
+                cmd_buffer.setScissor(0, overlay_scissor);
+                cmd_buffer.setViewport(0, overlay_viewport);
+                cmd_buffer.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(constants), &constants);
+                cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                        pipeline_layout, 0, draw.descriptor_set, nullptr);
+                cmd_buffer.draw(6, 1, 0, 0);
+        }
+}
+
+bool vulkan_display::set_color_lut_constants(fragment_push_constants& constants, vk::Format image_format) {
+        if (!color_lut_enabled) {
+                return false;
+        }
+        constants.lut_mode = static_cast<uint32_t>(color_lut_interpolation.load()) + 1;
+        constants.lut_srgb = is_srgb_format(image_format) ? 1 : 0;
+        constants.lut_size = static_cast<float>(color_lut.get_size());
+        constants.lut_domain_min = color_lut.get_domain_min();
+        constants.lut_domain_scale = color_lut.get_domain_scale();
+        return true;
+}
+
+void vulkan_display::prepare_mosaic(vk::CommandBuffer cmd_buffer, uint64_t frame_number) {
+        mosaic_draws.clear();
+        std::scoped_lock lock(mosaic_mutex);
+        auto& layout = current_mosaic_layout;
+        for (auto& stream : mosaic_streams) {
+                if (!stream.created) {
+                        continue;
+                }
+                if (stream.pending != mosaic_stream::no_image) {
+                        // the previous front image goes back to the producer
+                        stream.front = stream.pending;
+                        stream.pending = mosaic_stream::no_image;
+                        stream.front_changed = true;
+                }
+                if (stream.front == mosaic_stream::no_image || stream.parameters.tile >= layout.columns * layout.rows) {
+                        continue;
+                }
+                vk::Rect2D tile = get_mosaic_tile_rect(layout, stream.parameters.tile, context.window_size);
+                if (tile.extent.width * tile.extent.height == 0) {
+                        continue;
+                }
+
+                auto& image = stream.images[stream.front];
+                if (stream.front_changed) {
+                        // the frame is counted when it's drawn the first time, not when its tile is hidden
+                        stream.front_changed = false;
+                        stream.statistics.displayed_frames++;
+                        // mosaic images stay in the general layout like overlays
+                        auto memory_barrier = image.create_memory_barrier(
+                                vk::ImageLayout::eGeneral, vk::AccessFlagBits::eShaderRead);
+                        memory_barrier.setSrcAccessMask(vk::AccessFlagBits::eHostWrite);
+                        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eFragmentShader,
+                                vk::DependencyFlags{}, nullptr, nullptr, memory_barrier);
+                }
+                image.update_description_set(device, stream.descriptor_sets[stream.front], sampler, vk::ImageLayout::eGeneral);
+                stream.last_used_frame[stream.front] = frame_number;
+
+                mosaic_draw draw{ stream.descriptor_sets[stream.front], image.description.format, image.description.size,
+                        stream.parameters.transform };
+                update_render_area_viewport_scissor(draw.area, draw.viewport, draw.scissor, tile.extent,
+                        draw.image_size, draw.transform, filter == scaling_filter::integer);
+                // the image is fitted into the tile as into a window and then moved to the tile
+                draw.area.x += static_cast<uint32_t>(tile.offset.x);
+                draw.area.y += static_cast<uint32_t>(tile.offset.y);
+                draw.viewport
+                        .setX(draw.viewport.x + static_cast<float>(tile.offset.x))
+                        .setY(draw.viewport.y + static_cast<float>(tile.offset.y));
+                draw.scissor.offset.x += tile.offset.x;
+                draw.scissor.offset.y += tile.offset.y;
+                mosaic_draws.push_back(draw);
+        }
+}
+
+RETURN_TYPE vulkan_display::record_graphics_commands(uint32_t slot_id, transfer_image& transfer_image,
+        uint32_t swapchain_image_id, bool mipmapped, readback_ring::buffer* capture_buffer, bool redraw,
+        std::optional<uint32_t> field) 
+{
+        // previous submission of the slot is finished, it was waited in display_queued_image
+        PASS_RESULT(collect_gpu_time(slot_id));
+
+        vk::CommandBuffer cmd_buffer = frame_slots[slot_id].command_buffer;
         cmd_buffer.reset(vk::CommandBufferResetFlags{});
 
         vk::CommandBufferBeginInfo begin_info{};
         begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
         PASS_RESULT(cmd_buffer.begin(begin_info));
 
-        auto render_begin_memory_barrier = transfer_image.create_memory_barrier(
-                vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
-        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eFragmentShader,
-                vk::DependencyFlagBits::eByRegion, nullptr, nullptr, render_begin_memory_barrier);
+        uint32_t first_query = 2 * slot_id;
+        if (timestamp_pool) {
+                cmd_buffer.resetQueryPool(timestamp_pool, first_query, 2);
+                cmd_buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestamp_pool, first_query);
+        }
+
+        if (mipmapped) {
+                auto copy_memory_barrier = transfer_image.create_memory_barrier(
+                        vk::ImageLayout::eTransferSrcOptimal, vk::AccessFlagBits::eTransferRead);
+                cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eHost, vk::PipelineStageFlagBits::eTransfer,
+                        vk::DependencyFlags{}, nullptr, nullptr, copy_memory_barrier);
+                mipmap_image.record_generation(cmd_buffer, transfer_image.get_image());
+        } else if (transfer_image.is_staged()) {
+                // redrawn image and the second field stay in the shader read layout since the upload
+                if (!redraw && field.value_or(0) == 0) {
+                        transfer_image.record_upload(cmd_buffer);
+                        if (field) {
+                                vk::MemoryBarrier upload_barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead };
+                                cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader,
+                                        vk::DependencyFlags{}, upload_barrier, nullptr, nullptr);
+                        }
+                }
+        } else {
+                auto render_begin_memory_barrier = transfer_image.create_memory_barrier(
+                        vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+                auto read_stage = field ? vk::PipelineStageFlagBits::eComputeShader : vk::PipelineStageFlagBits::eFragmentShader;
+                cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eHost, read_stage,
+                        vk::DependencyFlagBits::eByRegion, nullptr, nullptr, render_begin_memory_barrier);
+        }
+        // redraw samples the last deinterlaced output, recording it again would overwrite the history
+        if (field && !redraw) {
+                bool top_field_first = transfer_image.field_order == field_order::top_field_first;
+                uint32_t field_parity = top_field_first ? *field : 1 - *field;
+                deinterlacer.record(cmd_buffer, descriptor_sets[transfer_image.id], deinterlacing, field_parity, *field == 1);
+        }
+        color_lut.record(cmd_buffer, transfer_image.frame_number);
+        prepare_overlays(cmd_buffer, transfer_image.frame_number);
 
         vk::RenderPassBeginInfo render_pass_begin_info;
         render_pass_begin_info
@@ -408,48 +885,167 @@ RETURN_TYPE vulkan_display::record_graphics_commands(transfer_image& transfer_im
                 .setFramebuffer(context.get_framebuffer(swapchain_image_id));
         cmd_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
 
-        cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        // mip chain is sampled by the bilinear pipeline, the sampler then filters trilinearly
+        scaling_filter filter = mipmapped ? scaling_filter::bilinear : render_area_filter;
+        cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines[static_cast<size_t>(filter)]);
 
         cmd_buffer.setScissor(0, scissor);
         cmd_buffer.setViewport(0, viewport);
-        cmd_buffer.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(render_area), &render_area);
+        fragment_push_constants constants{ render_area, 1.f };
+        set_uv_transform(constants, transfer_image.description.size, render_area_transform);
+        bool lut_applied = set_color_lut_constants(constants, transfer_image.description.format);
+        cmd_buffer.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(constants), &constants);
         cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                pipeline_layout, 0, descriptor_sets[transfer_image.id], nullptr);
+                pipeline_layout, 1, color_lut.get_descriptor_set(), nullptr);
+        vk::DescriptorSet descriptor_set = mipmapped ? mipmap_descriptor_set :
+                field ? deinterlace_descriptor_set : descriptor_sets[transfer_image.id];
+        cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                pipeline_layout, 0, descriptor_set, nullptr);
         cmd_buffer.draw(6, 1, 0, 0);
 
+        record_overlay_draws(cmd_buffer);
+
         cmd_buffer.endRenderPass();
 
-        auto render_end_memory_barrier = transfer_image.create_memory_barrier(
-                vk::ImageLayout::eGeneral, vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eHostRead);
-        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader, vk::PipelineStageFlagBits::eHost,
-                vk::DependencyFlagBits::eByRegion, nullptr, nullptr, render_end_memory_barrier);
+        if (timestamp_pool) {
+                cmd_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestamp_pool, first_query + 1);
+                frame_slots[slot_id].timestamp = { true, mipmapped, render_area_filter, lut_applied };
+        }
+        // copy is recorded after the timestamp, so it isn't included in the gpu time of the filter
+        if (capture_buffer) {
+                readback.record_copy(cmd_buffer, *capture_buffer, context.swapchain_images[swapchain_image_id].image);
+        }
+        if (mipmapped) {
+                std::scoped_lock lock(statistics_mutex);
+                mipmap_frame_statistics.generated_bytes += mipmap_image.get_generated_byte_count();
+        }
+        if (auto uploaded_bytes = color_lut.get_uploaded_byte_count(); uploaded_bytes != 0) {
+                std::scoped_lock lock(statistics_mutex);
+                lut_frame_statistics.uploaded_luts++;
+                lut_frame_statistics.uploaded_bytes += uploaded_bytes;
+        }
+
+        // host writes only into the staging buffer of compressed images
+        if (!transfer_image.is_staged()) {
+                auto render_end_memory_barrier = transfer_image.create_memory_barrier(
+                        vk::ImageLayout::eGeneral, vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eHostRead);
+                auto last_stage = mipmapped ? vk::PipelineStageFlagBits::eTransfer : 
+                        field ? vk::PipelineStageFlagBits::eComputeShader : vk::PipelineStageFlagBits::eFragmentShader;
+                cmd_buffer.pipelineBarrier(last_stage, vk::PipelineStageFlagBits::eHost,
+                        vk::DependencyFlagBits::eByRegion, nullptr, nullptr, render_end_memory_barrier);
+        }
 
         PASS_RESULT(cmd_buffer.end());
 
         return RETURN_TYPE();
 }
 
+void vulkan_display::resize_transfer_pool(transfer_image& acquired_image, int change, bool& acquired_image_retired) {
+        acquired_image_retired = false;
+        if (change < 0) {
+                // frame of the acquired image was already waited, so its memory can be released
+                image_cache.release_image(acquired_image, device);
+                std::scoped_lock lock(retired_images_mutex);
+                retired_images.push_back(&acquired_image);
+                acquired_image_retired = true;
+        } else if (change > 0) {
+                std::scoped_lock lock(retired_images_mutex);
+                assert(!retired_images.empty());
+                // retired image doesn't wait for any frame, so it's pushed at the front
+                available_img_queue.emplace_front(retired_images.back());
+                retired_images.pop_back();
+        }
+        filled_img_max_count = (pool_sizer.get_statistics().image_count + 1) / 2;
+}
+
+bool vulkan_display::is_image_format_supported(vk::Format format) {
+        using bits = vk::FormatFeatureFlagBits;
+        auto properties = context.gpu.getFormatProperties(format);
+        if (get_compressed_block_size(format) != 0) {
+                auto required = bits::eSampledImage | bits::eTransferDst;
+                return context.texture_compression_bc && (properties.optimalTilingFeatures & required) == required;
+        }
+        return static_cast<bool>(properties.linearTilingFeatures & bits::eSampledImage);
+}
+
 RETURN_TYPE vulkan_display::acquire_image(image& result, image_description description) {
+        acquire_refusal refusal = acquire_refusal::none;
+        PASS_RESULT(acquire_image_until(result, description, std::nullopt, refusal));
+        CHECK(refusal == acquire_refusal::none, "Transfer image would exceed the memory limit or the heap budget.");
+        return RETURN_TYPE();
+}
 
-        transfer_image& transfer_image = acquire_transfer_image(available_img_queue, 
-                filled_img_queue, filled_img_max_count);
-        assert(transfer_image.id != transfer_image::NO_ID);
-        {
-                std::unique_lock device_lock(device_mutex, std::defer_lock);
-                if (transfer_image.fence_set) {
-                        device_lock.lock();
-                        CHECK(device.waitForFences(transfer_image.is_available_fence, VK_TRUE, UINT64_MAX),
-                                "Waiting for fence failed.");
+RETURN_TYPE vulkan_display::acquire_image_until(image& result, image_description description,
+        std::optional<std::chrono::steady_clock::time_point> deadline, acquire_refusal& refusal)
+{
+        result = image{};
+        refusal = acquire_refusal::none;
+        transfer_image* acquired = nullptr;
+        while (!acquired) {
+                auto available_count = available_img_queue.size();
+                bool dropped = false;
+                auto acquire_start = std::chrono::steady_clock::now();
+                trace_scope trace{ "acquire_transfer_image" };
+                auto* transfer_image = acquire_transfer_image(available_img_queue, 
+                        filled_img_queue, filled_img_max_count, description, deadline, dropped);
+                if (!transfer_image) {
+                        refusal = acquire_refusal::pool_exhausted;
+                } else if (deadline && !dropped) {
+                        // a stolen image was waited by the producer which filled it, so it's never refused
+                        // and the stolen frame isn't lost by a refusal
+                        auto timeout = std::max(*deadline - std::chrono::steady_clock::now(),
+                                std::chrono::steady_clock::duration::zero());
+                        bool finished = false;
+                        PASS_RESULT(wait_for_timeline_value(finished, device, context.queue_timeline,
+                                transfer_image->frame_number,
+                                static_cast<uint64_t>(std::chrono::nanoseconds(timeout).count())));
+                        if (!finished) {
+                                // the image goes back to the front, so the next acquire tries it first
+                                available_img_queue.emplace_front(transfer_image);
+                                refusal = acquire_refusal::gpu_busy;
+                        }
+                } else {
+                        // usually only the counter of the timeline is read
+                        PASS_RESULT(wait_for_frame(transfer_image->frame_number));
                 }
-
-                if (transfer_image.description != description) {
-                        if (!device_lock.owns_lock()) {
-                                device_lock.lock();
+                if (refusal != acquire_refusal::none) {
+                        trace.set_argument("refusal", static_cast<uint64_t>(refusal));
+                        if (adaptive_transfer_pool) {
+                                // refused producers stalled as well, so the pool can grow
+                                pool_sizer.record_acquire(std::chrono::steady_clock::now() - acquire_start,
+                                        available_count, dropped);
+                        }
+                        return RETURN_TYPE();
+                }
+                assert(transfer_image->id != transfer_image::NO_ID);
+                trace.set_image_id(transfer_image->id);
+                trace.set_argument("stolen", dropped);
+                acquired = transfer_image;
+
+                if (adaptive_transfer_pool) {
+                        auto now = std::chrono::steady_clock::now();
+                        pool_sizer.record_acquire(now - acquire_start, available_count, dropped);
+                        int change = pool_sizer.evaluate(now);
+                        if (change != 0) {
+                                bool retired = false;
+                                resize_transfer_pool(*transfer_image, change, retired);
+                                if (retired) {
+                                        acquired = nullptr;
+                                }
                         }
-                        //todo another formats
-                        transfer_image.create(device, context.gpu, description);
                 }
         }
+        transfer_image& transfer_image = *acquired;
+        // image is owned by this producer until it is queued, only the cache itself is locked
+        //todo another formats
+        bool prepared = false;
+        PASS_RESULT(image_cache.prepare_image(prepared, transfer_image, context, description));
+        if (!prepared) {
+                // the image doesn't wait for any frame now, so the next acquire tries it first
+                available_img_queue.emplace_front(&transfer_image);
+                refusal = acquire_refusal::memory_limit;
+                return RETURN_TYPE();
+        }
         result = image{ transfer_image };
         return RETURN_TYPE();
 }
@@ -457,85 +1053,346 @@ RETURN_TYPE vulkan_display::acquire_image(image& result, image_description descr
 RETURN_TYPE vulkan_display::copy_and_queue_image(std::byte* frame, image_description description) {
         image image;
         acquire_image(image, description);
-        memcpy(image.get_memory_ptr(), frame, image.get_size().height * image.get_row_pitch());
+        memcpy(image.get_memory_ptr(), frame, image.get_data_size());
         queue_image(image);
         return RETURN_TYPE();
 }
 
 RETURN_TYPE vulkan_display::queue_image(image image) {
+        trace_scope trace{ "queue_image" };
+        if (auto* transfer_image = image.get_transfer_image()) {
+                transfer_image->queue_time = std::chrono::steady_clock::now();
+                trace.set_image_id(transfer_image->id);
+        }
+        if (preprocess_pool.is_running()) {
+                preprocess_pool.push(image);
+                return RETURN_TYPE();
+        }
         filled_img_queue.push(image);
         return RETURN_TYPE();
 }
 
 RETURN_TYPE vulkan_display::display_queued_image() {
+        bool displayed = false;
+        PASS_RESULT(display_queued_image_until(displayed, std::nullopt));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::display_queued_image_until(bool& displayed,
+        std::optional<std::chrono::steady_clock::time_point> deadline)
+{
+        displayed = false;
+        if (!keep_last_image && last_image) {
+                available_img_queue.push(last_image);
+                last_image = nullptr;
+        }
         auto window_parameters = window->get_window_parameters();
         if (window_parameters.width * window_parameters.height == 0) {
-                auto image = filled_img_queue.try_pop();
+                // the minimalised window cannot be redrawn, restoring it requests a redraw again
+                redraw_requested = false;
+                if (pending_second_field) {
+                        release_displayed_image(*std::exchange(pending_second_field, nullptr));
+                }
+                auto image = deadline ? pop_filled_image(*deadline) : filled_img_queue.try_pop();
                 if (image.has_value()) {
                         discard_image(*image);
                 }
                 return RETURN_TYPE();
         }
 
-        auto image = filled_img_queue.pop();
-        if (!image.get_transfer_image()) {
+        if (pending_second_field) {
+                // the field is presented a field period after the first one, when the caller displays again
+                redraw_requested = false;
+                transfer_image& transfer_image = *std::exchange(pending_second_field, nullptr);
+                PASS_RESULT(render_image(displayed, transfer_image, false, 1));
+                if (displayed && low_latency_mode) {
+                        PASS_RESULT(wait_for_frame(transfer_image.frame_number));
+                }
+                release_displayed_image(transfer_image);
                 return RETURN_TYPE();
         }
+        auto queued = pop_filled_image(deadline);
+        if (!queued) {
+                // no new frame, the kept image is drawn again only if the window changed
+                if (redraw_requested.exchange(false) && last_image) {
+                        // interlaced image is redrawn from the output of its last displayed field
+                        PASS_RESULT(render_image(displayed, *last_image, true, 1));
+                        if (displayed && low_latency_mode) {
+                                PASS_RESULT(wait_for_frame(last_image->frame_number));
+                        }
+                }
+                return RETURN_TYPE();
+        }
+        // the new frame is drawn with the current window parameters
+        redraw_requested = false;
+        if (low_latency_mode) {
+                pick_latest_image(*queued);
+        }
+        image image = *queued;
 
-        image.preprocess();
+        preprocess_image(image);
 
         transfer_image& transfer_image = *image.get_transfer_image();
+        PASS_RESULT(render_image(displayed, transfer_image, false));
+        if (!displayed) {
+                discard_image(image);
+                return RETURN_TYPE();
+        }
+        if (low_latency_mode) {
+                // every frame is waited right after its submission, so only one frame is in flight
+                // and the next image is picked as late as possible
+                PASS_RESULT(record_frame_latency(transfer_image.frame_number, transfer_image.queue_time));
+        }
+        if (is_deinterlaced(transfer_image)) {
+                // the second field is presented as a separate frame by the next call, the image stays uploaded
+                pending_second_field = &transfer_image;
+                return RETURN_TYPE();
+        }
+        release_displayed_image(transfer_image);
+        return RETURN_TYPE();
+}
 
-        auto& semaphores = image_semaphores[transfer_image.id];
+void vulkan_display::release_displayed_image(transfer_image& transfer_image) {
+        if (keep_last_image) {
+                if (last_image) {
+                        available_img_queue.push(last_image);
+                }
+                last_image = &transfer_image;
+                return;
+        }
+        available_img_queue.push(&transfer_image);
+}
 
+RETURN_TYPE vulkan_display::render_image(bool& displayed, transfer_image& transfer_image, bool redraw, uint32_t field) {
+        displayed = false;
         uint32_t swapchain_image_id = 0;
-        std::unique_lock lock(device_mutex);
-        if (transfer_image.description != current_image_description) {
+        // the swapchain cannot be recreated by window_parameters_changed until the frame is presented
+        std::scoped_lock lock(device_mutex);
+        uint32_t slot_id = frame_slot_id;
+        auto& slot = frame_slots[slot_id];
+        // limits the number of frames in flight, semaphores and the command buffer of the slot are reused
+        PASS_RESULT(wait_for_frame(slot.frame_number));
+        scaling_filter requested_filter = filter;
+        image_transform requested_transform{};
+        {
+                std::scoped_lock transform_lock(transform_mutex);
+                requested_transform = transform;
+        }
+        if (transfer_image.description != current_image_description || requested_filter != render_area_filter ||
+                requested_transform != render_area_transform)
+        {
                 current_image_description = transfer_image.description;
+                render_area_filter = requested_filter;
+                render_area_transform = requested_transform;
                 auto parameters = context.get_window_parameters();
                 update_render_area_viewport_scissor(render_area, viewport, scissor,
-                        { parameters.width, parameters.height }, current_image_description.size);
+                        { parameters.width, parameters.height }, current_image_description.size, render_area_transform,
+                        render_area_filter == scaling_filter::integer);
         }
-        PASS_RESULT(context.acquire_next_swapchain_image(swapchain_image_id, semaphores.image_acquired));
-        while (swapchain_image_id == SWAPCHAIN_IMAGE_OUT_OF_DATE) {
-                window_parameters = window->get_window_parameters();
-                if (window_parameters.width * window_parameters.height == 0) {
-                        // window is minimalised
-                        auto image = filled_img_queue.try_pop();
-                        if (image.has_value()) {
-                                discard_image(*image);
-                        }
-                        return RETURN_TYPE();
+        {
+                trace_scope trace{ redraw ? "acquire_swapchain_image_redraw" : "acquire_swapchain_image",
+                        submitted_frame_count + 1, transfer_image.id };
+                PASS_RESULT(acquire_swapchain_image(swapchain_image_id, slot.image_acquired));
+        }
+        if (swapchain_image_id == SWAPCHAIN_IMAGE_OUT_OF_DATE) {
+                return RETURN_TYPE();
+        }
+        bool deinterlaced = false;
+        PASS_RESULT(update_deinterlacer(deinterlaced, transfer_image));
+        bool mipmapped = false;
+        if (!deinterlaced) {
+                PASS_RESULT(update_mipmap_image(mipmapped, transfer_image.description));
+        }
+        if (!mipmapped) {
+                transfer_image.update_description_set(device, descriptor_sets[transfer_image.id], sampler);
+        }
+        PASS_RESULT(color_lut.prepare_upload(device, context.gpu, context.queue_timeline));
+        transfer_image.frame_number = ++submitted_frame_count;
+        slot.frame_number = transfer_image.frame_number;
+        readback_ring::buffer* capture_buffer = nullptr;
+        if (readback.is_enabled()) {
+                PASS_RESULT(readback.acquire_buffer(capture_buffer, context.window_size,
+                        context.swapchain_atributes.format.format, transfer_image.frame_number));
+        }
+
+        PASS_RESULT(record_graphics_commands(slot_id, transfer_image, swapchain_image_id, mipmapped, capture_buffer, redraw,
+                deinterlaced ? std::optional{ field } : std::nullopt));
+        {
+                trace_scope trace{ "submit", slot.frame_number, transfer_image.id };
+                PASS_RESULT(submit_frame(slot.command_buffer, slot.image_acquired, slot.image_rendered, slot.frame_number));
+        }
+        frame_slot_id = (frame_slot_id + 1) % static_cast<uint32_t>(frame_slots.size());
+        if (capture_buffer) {
+                readback.submit(*capture_buffer);
+        }
+
+        {
+                trace_scope trace{ "present", slot.frame_number, transfer_image.id };
+                PASS_RESULT(present_swapchain_image(swapchain_image_id, slot.image_rendered));
+        }
+        displayed = true;
+        return RETURN_TYPE();
+}
+
+std::optional<image> vulkan_display::pop_filled_image(
+        std::optional<std::chrono::steady_clock::time_point> deadline)
+{
+        auto [lock, deque] = filled_img_queue.get_underlying_deque();
+        auto& queue_non_empty = filled_img_queue.get_queue_non_empty_condition_var();
+        auto woken = [&d = deque, this]() { return !d.empty() || redraw_requested; };
+        if (deadline) {
+                queue_non_empty.wait_until(lock, *deadline, woken);
+        } else {
+                queue_non_empty.wait(lock, woken);
+        }
+        if (deque.empty()) {
+                return {};
+        }
+        image result = deque.front();
+        deque.pop_front();
+        return result;
+}
+
+void vulkan_display::request_redraw() {
+        if (!keep_last_image) {
+                return;
+        }
+        {
+                auto [lock, deque] = filled_img_queue.get_underlying_deque();
+                redraw_requested = true;
+        }
+        filled_img_queue.get_queue_non_empty_condition_var().notify_all();
+}
+
+RETURN_TYPE vulkan_display::record_frame_latency(uint64_t frame_number,
+        std::chrono::steady_clock::time_point queue_time)
+{
+        PASS_RESULT(wait_for_frame(frame_number));
+        auto now = std::chrono::steady_clock::now();
+
+        double latency_ms = std::chrono::duration<double, std::milli>(now - queue_time).count();
+        std::scoped_lock lock(statistics_mutex);
+        auto& statistics = frame_latency_statistics;
+        statistics.frame_count++;
+        statistics.total_ms += latency_ms;
+        statistics.last_ms = latency_ms;
+        statistics.max_ms = std::max(statistics.max_ms, latency_ms);
+        return RETURN_TYPE();
+}
+
+void vulkan_display::pick_latest_image(image& image) {
+        // the previous frame is already finished, so the image is picked as late as possible
+        uint64_t skipped_frames = 0;
+        while (auto newer = filled_img_queue.try_pop()) {
+                discard_image(image);
+                skipped_frames++;
+                image = *newer;
+        }
+        std::scoped_lock lock(statistics_mutex);
+        frame_latency_statistics.skipped_frames += skipped_frames;
+}
+
+void vulkan_display::preprocess_image(image& image) {
+        auto* transfer_image = image.get_transfer_image();
+        if (transfer_image->preprocessed) {
+                return;
+        }
+        transfer_image->preprocessed = true;
+        trace_scope trace{ "preprocess", 0, transfer_image->id };
+        if (image.has_process_function()) {
+                image.preprocess();
+                return;
+        }
+        preprocess_function function;
+        {
+                // the function is copied, so it can be replaced meanwhile and workers don't wait for each other
+                std::scoped_lock lock(preprocess_mutex);
+                auto format = image.get_description().format;
+                auto it = std::find_if(format_preprocess_functions.begin(), format_preprocess_functions.end(),
+                        [format](auto& pair) { return pair.first == format; });
+                if (it == format_preprocess_functions.end()) {
+                        return;
+                }
+                function = it->second;
+        }
+        function(image);
+}
+
+void vulkan_display::set_preprocess_thread_count(uint32_t thread_count) {
+        preprocess_pool.stop();
+        if (thread_count > 0) {
+                // every image in the pool holds a transfer image
+                preprocess_pool.start(thread_count, transfer_image_count,
+                        [this](image& image) { preprocess_image(image); }, filled_img_queue);
+        }
+}
+
+void vulkan_display::set_format_preprocess_function(vk::Format format, preprocess_function function) {
+        std::scoped_lock lock(preprocess_mutex);
+        auto it = std::find_if(format_preprocess_functions.begin(), format_preprocess_functions.end(),
+                [format](auto& pair) { return pair.first == format; });
+        if (it != format_preprocess_functions.end()) {
+                if (function) {
+                        it->second = std::move(function);
+                } else {
+                        format_preprocess_functions.erase(it);
                 }
-                window_parameters_changed(window_parameters);
-                PASS_RESULT(context.acquire_next_swapchain_image(swapchain_image_id, semaphores.image_acquired));
+        } else if (function) {
+                format_preprocess_functions.emplace_back(format, std::move(function));
         }
-        transfer_image.update_description_set(device, descriptor_sets[transfer_image.id], sampler);
-        lock.unlock();
+}
+
+RETURN_TYPE vulkan_display::submit_frame(vk::CommandBuffer cmd_buffer, vk::Semaphore image_acquired, 
+        vk::Semaphore image_rendered, uint64_t frame_number)
+{
+        vk::PipelineStageFlags wait_mask = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+        std::array signal_semaphores{ image_rendered, context.queue_timeline };
+        // values of binary semaphores are ignored
+        uint64_t wait_value = 0;
+        std::array<uint64_t, 2> signal_values{ 0, frame_number };
+        vk::TimelineSemaphoreSubmitInfo timeline_info{};
+        timeline_info
+                .setWaitSemaphoreValueCount(1)
+                .setPWaitSemaphoreValues(&wait_value)
+                .setSignalSemaphoreValueCount(static_cast<uint32_t>(signal_values.size()))
+                .setPSignalSemaphoreValues(signal_values.data());
 
-        record_graphics_commands(transfer_image, swapchain_image_id);
-        transfer_image.fence_set = true;
-        device.resetFences(transfer_image.is_available_fence);
-        std::vector<vk::PipelineStageFlags> wait_masks{ vk::PipelineStageFlagBits::eColorAttachmentOutput };
         vk::SubmitInfo submit_info{};
         submit_info
+                .setPNext(&timeline_info)
                 .setCommandBufferCount(1)
-                .setPCommandBuffers(&command_buffers[transfer_image.id])
-                .setPWaitDstStageMask(wait_masks.data())
+                .setPCommandBuffers(&cmd_buffer)
+                .setPWaitDstStageMask(&wait_mask)
                 .setWaitSemaphoreCount(1)
-                .setPWaitSemaphores(&semaphores.image_acquired)
-                .setSignalSemaphoreCount(1)
-                .setPSignalSemaphores(&semaphores.image_rendered);
+                .setPWaitSemaphores(&image_acquired)
+                .setSignalSemaphoreCount(static_cast<uint32_t>(signal_semaphores.size()))
+                .setPSignalSemaphores(signal_semaphores.data());
+        PASS_RESULT(context.queue.submit(submit_info, nullptr));
+        return RETURN_TYPE();
+}
 
-        PASS_RESULT(context.queue.submit(submit_info, transfer_image.is_available_fence));
+RETURN_TYPE vulkan_display::acquire_swapchain_image(uint32_t& swapchain_image_id, vk::Semaphore image_acquired) {
+        PASS_RESULT(context.acquire_next_swapchain_image(swapchain_image_id, image_acquired));
+        while (swapchain_image_id == SWAPCHAIN_IMAGE_OUT_OF_DATE) {
+                auto window_parameters = window->get_window_parameters();
+                if (window_parameters.width * window_parameters.height == 0) {
+                        // window is minimalised
+                        return RETURN_TYPE();
+                }
+                PASS_RESULT(update_window_parameters(window_parameters));
+                PASS_RESULT(context.acquire_next_swapchain_image(swapchain_image_id, image_acquired));
+        }
+        return RETURN_TYPE();
+}
 
+RETURN_TYPE vulkan_display::present_swapchain_image(uint32_t swapchain_image_id, vk::Semaphore image_rendered) {
         vk::PresentInfoKHR present_info{};
         present_info
                 .setPImageIndices(&swapchain_image_id)
                 .setSwapchainCount(1)
                 .setPSwapchains(&context.swapchain)
                 .setWaitSemaphoreCount(1)
-                .setPWaitSemaphores(&semaphores.image_rendered);
+                .setPWaitSemaphores(&image_rendered);
 
         auto present_result = context.queue.presentKHR(&present_info);
         if (present_result != vk::Result::eSuccess) {
@@ -547,16 +1404,421 @@ RETURN_TYPE vulkan_display::display_queued_image() {
                 default: CHECK(false, "Error presenting image:"s + vk::to_string(present_result));
                 }
         }
+        return RETURN_TYPE();
+}
 
-        available_img_queue.push(&transfer_image);
+RETURN_TYPE vulkan_display::set_tiled_image(tile_source* source, tiled_image_parameters parameters) {
+        std::scoped_lock lock(device_mutex);
+        if (!tiled_image.is_initialised()) {
+                // tile shaders are loaded only by applications using tiled images
+                PASS_RESULT(create_shader(tile_vertex_shader, "shaders/tile_vert.spv", device));
+                PASS_RESULT(create_shader(tile_fragment_shader, "shaders/tile_frag.spv", device));
+                PASS_RESULT(tiled_image.init(device, render_pass, tile_vertex_shader, tile_fragment_shader));
+                PASS_RESULT(create_frame_slots(tiled_frames.data(), static_cast<uint32_t>(tiled_frames.size())));
+        }
+        // cache of the previous source can be still used by the gpu
+        PASS_RESULT(device.waitIdle());
+        PASS_RESULT(tiled_image.set_source(device, context.gpu, source, parameters));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::display_tiled_image() {
+        auto window_parameters = window->get_window_parameters();
+        if (window_parameters.width * window_parameters.height == 0) {
+                return RETURN_TYPE();
+        }
+        tiled_view view;
+        {
+                std::scoped_lock view_lock(tiled_view_mutex);
+                view = current_tiled_view;
+        }
+
+        std::scoped_lock lock(device_mutex);
+        CHECK(tiled_image.has_source(), "Tiled image is not set.");
+        auto& frame = tiled_frames[tiled_frame_id];
+        // staging and instance buffers of the frame slot are reused
+        PASS_RESULT(wait_for_frame(frame.frame_number));
+
+        uint32_t swapchain_image_id = 0;
+        {
+                trace_scope trace{ "acquire_swapchain_image", submitted_frame_count + 1 };
+                PASS_RESULT(acquire_swapchain_image(swapchain_image_id, frame.image_acquired));
+        }
+        if (swapchain_image_id == SWAPCHAIN_IMAGE_OUT_OF_DATE) {
+                return RETURN_TYPE();
+        }
+
+        vk::CommandBuffer cmd_buffer = frame.command_buffer;
+        cmd_buffer.reset(vk::CommandBufferResetFlags{});
+        vk::CommandBufferBeginInfo begin_info{};
+        begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        PASS_RESULT(cmd_buffer.begin(begin_info));
+
+        PASS_RESULT(tiled_image.record_uploads(cmd_buffer, tiled_frame_id, context.window_size, view));
+
+        vk::RenderPassBeginInfo render_pass_begin_info;
+        render_pass_begin_info
+                .setRenderPass(render_pass)
+                .setRenderArea(vk::Rect2D{ {0,0}, context.window_size })
+                .setClearValueCount(1)
+                .setPClearValues(&clear_color)
+                .setFramebuffer(context.get_framebuffer(swapchain_image_id));
+        cmd_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+        tiled_image.record_draw(cmd_buffer, context.window_size);
+        cmd_buffer.endRenderPass();
+        PASS_RESULT(cmd_buffer.end());
+
+        frame.frame_number = ++submitted_frame_count;
+        {
+                trace_scope trace{ "submit", frame.frame_number };
+                PASS_RESULT(submit_frame(cmd_buffer, frame.image_acquired, frame.image_rendered, frame.frame_number));
+        }
+        {
+                trace_scope trace{ "present", frame.frame_number };
+                PASS_RESULT(present_swapchain_image(swapchain_image_id, frame.image_rendered));
+        }
+
+        tiled_frame_id = (tiled_frame_id + 1) % static_cast<uint32_t>(tiled_frames.size());
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::display_mosaic(bool& displayed) {
+        displayed = false;
+        auto window_parameters = window->get_window_parameters();
+        if (window_parameters.width * window_parameters.height == 0) {
+                return RETURN_TYPE();
+        }
+
+        std::scoped_lock lock(device_mutex);
+        uint32_t slot_id = frame_slot_id;
+        auto& slot = frame_slots[slot_id];
+        // only the command buffer and semaphores of the slot are reused, producers wait for their images themselves
+        PASS_RESULT(wait_for_frame(slot.frame_number));
+        PASS_RESULT(collect_gpu_time(slot_id));
+
+        uint32_t swapchain_image_id = 0;
+        {
+                trace_scope trace{ "acquire_swapchain_image", submitted_frame_count + 1 };
+                PASS_RESULT(acquire_swapchain_image(swapchain_image_id, slot.image_acquired));
+        }
+        if (swapchain_image_id == SWAPCHAIN_IMAGE_OUT_OF_DATE) {
+                return RETURN_TYPE();
+        }
+        PASS_RESULT(color_lut.prepare_upload(device, context.gpu, context.queue_timeline));
+        slot.frame_number = ++submitted_frame_count;
+
+        vk::CommandBuffer cmd_buffer = slot.command_buffer;
+        cmd_buffer.reset(vk::CommandBufferResetFlags{});
+        vk::CommandBufferBeginInfo begin_info{};
+        begin_info.setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+        PASS_RESULT(cmd_buffer.begin(begin_info));
+
+        color_lut.record(cmd_buffer, slot.frame_number);
+        prepare_mosaic(cmd_buffer, slot.frame_number);
+
+        vk::RenderPassBeginInfo render_pass_begin_info;
+        render_pass_begin_info
+                .setRenderPass(render_pass)
+                .setRenderArea(vk::Rect2D{ {0,0}, context.window_size })
+                .setClearValueCount(1)
+                .setPClearValues(&clear_color)
+                .setFramebuffer(context.get_framebuffer(swapchain_image_id));
+        cmd_buffer.beginRenderPass(render_pass_begin_info, vk::SubpassContents::eInline);
+        // every tile is drawn by the same pipeline, tiles differ only in the viewport and the descriptor set
+        cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines[static_cast<size_t>(filter.load())]);
+        cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                pipeline_layout, 1, color_lut.get_descriptor_set(), nullptr);
+        for (auto& draw : mosaic_draws) {
+                fragment_push_constants constants{ draw.area, 1.f };
+                set_uv_transform(constants, draw.image_size, draw.transform);
+                set_color_lut_constants(constants, draw.format);
+                cmd_buffer.setScissor(0, draw.scissor);
+                cmd_buffer.setViewport(0, draw.viewport);
+                cmd_buffer.pushConstants(pipeline_layout, vk::ShaderStageFlagBits::eFragment, 0, sizeof(constants), &constants);
+                cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                        pipeline_layout, 0, draw.descriptor_set, nullptr);
+                cmd_buffer.draw(6, 1, 0, 0);
+        }
+        cmd_buffer.endRenderPass();
+        PASS_RESULT(cmd_buffer.end());
+
+        {
+                trace_scope trace{ "submit", slot.frame_number };
+                trace.set_argument("tiles", mosaic_draws.size());
+                PASS_RESULT(submit_frame(cmd_buffer, slot.image_acquired, slot.image_rendered, slot.frame_number));
+        }
+        frame_slot_id = (frame_slot_id + 1) % static_cast<uint32_t>(frame_slots.size());
+        {
+                trace_scope trace{ "present", slot.frame_number };
+                PASS_RESULT(present_swapchain_image(swapchain_image_id, slot.image_rendered));
+        }
+        displayed = true;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_mosaic_layout(mosaic_layout layout) {
+        CHECK(layout.columns > 0 && layout.rows > 0, "Mosaic needs at least one column and one row.");
+        std::scoped_lock lock(mosaic_mutex);
+        current_mosaic_layout = layout;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::create_mosaic_stream(uint32_t& stream_id, mosaic_stream_parameters parameters) {
+        CHECK(parameters.image_count >= 3 && parameters.image_count <= max_mosaic_stream_image_count,
+                "Mosaic stream needs 3 to max_mosaic_stream_image_count images.");
+        CHECK(parameters.transform.crop.offset.x >= 0 && parameters.transform.crop.offset.y >= 0,
+                "Crop offset cannot be negative.");
+        std::scoped_lock lock(mosaic_mutex);
+        auto it = std::find_if(mosaic_streams.begin(), mosaic_streams.end(), [](auto& stream) { return !stream.created; });
+        CHECK(it != mosaic_streams.end(), "Maximum number of mosaic streams reached.");
+        it->created = true;
+        it->parameters = parameters;
+        it->acquired = {};
+        it->front = mosaic_stream::no_image;
+        it->pending = mosaic_stream::no_image;
+        it->front_changed = false;
+        it->statistics = {};
+        stream_id = static_cast<uint32_t>(it - mosaic_streams.begin());
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::destroy_mosaic_stream(uint32_t stream_id) {
+        std::scoped_lock lock(mosaic_mutex);
+        CHECK(stream_id < max_mosaic_stream_count && mosaic_streams[stream_id].created, "Invalid mosaic stream id.");
+        mosaic_streams[stream_id].created = false;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_mosaic_stream_tile(uint32_t stream_id, uint32_t tile) {
+        std::scoped_lock lock(mosaic_mutex);
+        CHECK(stream_id < max_mosaic_stream_count && mosaic_streams[stream_id].created, "Invalid mosaic stream id.");
+        mosaic_streams[stream_id].parameters.tile = tile;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_mosaic_stream_transform(uint32_t stream_id, const image_transform& transform) {
+        CHECK(transform.crop.offset.x >= 0 && transform.crop.offset.y >= 0, "Crop offset cannot be negative.");
+        std::scoped_lock lock(mosaic_mutex);
+        CHECK(stream_id < max_mosaic_stream_count && mosaic_streams[stream_id].created, "Invalid mosaic stream id.");
+        mosaic_streams[stream_id].parameters.transform = transform;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::acquire_mosaic_image(uint32_t stream_id, image& result, image_description description) {
+        CHECK(stream_id < max_mosaic_stream_count, "Invalid mosaic stream id.");
+        // mosaic images stay in the general layout written by the host, which compressed images don't support
+        CHECK(get_compressed_block_size(description.format) == 0, "Mosaic images cannot be compressed.");
+        auto& stream = mosaic_streams[stream_id];
+        uint32_t image_id = 0;
+        uint64_t last_used_frame = 0;
+        {
+                std::scoped_lock lock(mosaic_mutex);
+                CHECK(stream.created, "Invalid mosaic stream id.");
+                uint32_t image_count = stream.parameters.image_count;
+                while (image_id < image_count && (stream.acquired[image_id] ||
+                        image_id == stream.front || image_id == stream.pending))
+                {
+                        image_id++;
+                }
+                CHECK(image_id < image_count, "All images of the mosaic stream are acquired.");
+                stream.acquired[image_id] = true;
+                last_used_frame = stream.last_used_frame[image_id];
+        }
+
+        transfer_image& transfer_image = stream.images[image_id];
+        PASS_RESULT(wait_for_frame(last_used_frame));
+        if (transfer_image.description != description) {
+                PASS_RESULT(transfer_image.create(device, context.gpu, description));
+        }
+        result = image{ transfer_image };
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::queue_mosaic_image(uint32_t stream_id, image image) {
+        CHECK(stream_id < max_mosaic_stream_count, "Invalid mosaic stream id.");
+        preprocess_image(image);
+
+        auto& stream = mosaic_streams[stream_id];
+        std::scoped_lock lock(mosaic_mutex);
+        auto it = std::find_if(stream.images.begin(), stream.images.end(),
+                [&image](auto& transfer_image) { return &transfer_image == image.get_transfer_image(); });
+        auto image_id = static_cast<uint32_t>(it - stream.images.begin());
+        CHECK(stream.created && it != stream.images.end() && stream.acquired[image_id],
+                "Image wasn't acquired for the mosaic stream.");
+        stream.acquired[image_id] = false;
+        stream.statistics.queued_frames++;
+        if (stream.pending != mosaic_stream::no_image) {
+                stream.statistics.dropped_frames++;
+                if (stream.parameters.drop_policy == stream_drop_policy::drop_newest) {
+                        // the image wasn't drawn, so it can be acquired again without waiting
+                        return RETURN_TYPE();
+                }
+        }
+        stream.pending = image_id;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::copy_and_queue_mosaic_image(uint32_t stream_id, std::byte* frame, image_description description) {
+        image image;
+        PASS_RESULT(acquire_mosaic_image(stream_id, image, description));
+        memcpy(image.get_memory_ptr(), frame, image.get_size().height * image.get_row_pitch());
+        PASS_RESULT(queue_mosaic_image(stream_id, image));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::get_mosaic_stream_statistics(mosaic_stream_statistics& statistics, uint32_t stream_id) {
+        std::scoped_lock lock(mosaic_mutex);
+        CHECK(stream_id < max_mosaic_stream_count && mosaic_streams[stream_id].created, "Invalid mosaic stream id.");
+        statistics = mosaic_streams[stream_id].statistics;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::create_overlay(uint32_t& overlay_id, overlay_parameters parameters) {
+        std::scoped_lock lock(overlay_mutex);
+        auto it = std::find_if(overlays.begin(), overlays.end(), [](auto& overlay) { return !overlay.created; });
+        CHECK(it != overlays.end(), "Maximum number of overlays reached.");
+        it->created = true;
+        it->parameters = parameters;
+        it->front_filled = false;
+        it->front_changed = false;
+        overlay_id = static_cast<uint32_t>(it - overlays.begin());
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::destroy_overlay(uint32_t overlay_id) {
+        std::scoped_lock lock(overlay_mutex);
+        CHECK(overlay_id < max_overlay_count && overlays[overlay_id].created, "Invalid overlay id.");
+        overlays[overlay_id].created = false;
+        overlays[overlay_id].front_filled = false;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_overlay_parameters(uint32_t overlay_id, overlay_parameters parameters) {
+        std::scoped_lock lock(overlay_mutex);
+        CHECK(overlay_id < max_overlay_count && overlays[overlay_id].created, "Invalid overlay id.");
+        overlays[overlay_id].parameters = parameters;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::acquire_overlay_image(uint32_t overlay_id, image& result, image_description description) {
+        CHECK(overlay_id < max_overlay_count, "Invalid overlay id.");
+        // overlays stay in the general layout written by the host, which compressed images don't support
+        CHECK(get_compressed_block_size(description.format) == 0, "Overlay images cannot be compressed.");
+        auto& overlay = overlays[overlay_id];
+        uint32_t back = 0;
+        uint64_t last_used_frame = 0;
+        {
+                std::scoped_lock lock(overlay_mutex);
+                CHECK(overlay.created, "Invalid overlay id.");
+                back = 1 - overlay.front;
+                last_used_frame = overlay.last_used_frame[back];
+        }
+
+        transfer_image& transfer_image = overlay.images[back];
+        PASS_RESULT(wait_for_frame(last_used_frame));
+        if (transfer_image.description != description) {
+                PASS_RESULT(transfer_image.create(device, context.gpu, description));
+        }
+        result = image{ transfer_image };
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::queue_overlay_image(uint32_t overlay_id, image image) {
+        CHECK(overlay_id < max_overlay_count, "Invalid overlay id.");
+        preprocess_image(image);
+
+        auto& overlay = overlays[overlay_id];
+        std::scoped_lock lock(overlay_mutex);
+        CHECK(overlay.created && image.get_transfer_image() == &overlay.images[1 - overlay.front],
+                "Image wasn't acquired for the overlay.");
+        overlay.front = 1 - overlay.front;
+        overlay.front_filled = true;
+        overlay.front_changed = true;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::copy_and_queue_overlay_image(uint32_t overlay_id, std::byte* frame, image_description description) {
+        image image;
+        PASS_RESULT(acquire_overlay_image(overlay_id, image, description));
+        memcpy(image.get_memory_ptr(), frame, image.get_size().height * image.get_row_pitch());
+        PASS_RESULT(queue_overlay_image(overlay_id, image));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::start_frame_capture(frame_capture_callback* callback, uint32_t buffer_count) {
+        assert(callback);
+        std::scoped_lock lock(device_mutex);
+        if (!context.swapchain_readback) {
+                auto supported_usage = context.swapchain_atributes.capabilities.supportedUsageFlags;
+                CHECK(static_cast<bool>(supported_usage & vk::ImageUsageFlagBits::eTransferSrc),
+                        "Swapchain images cannot be read back.");
+                context.swapchain_readback = true;
+                PASS_RESULT(context.recreate_swapchain(context.get_window_parameters(), render_pass));
+        }
+        if (!readback.is_initialised()) {
+                PASS_RESULT(readback.init(device, context.gpu, context.queue_timeline, buffer_count));
+        }
+        readback.set_callback(callback);
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_image_transform(const image_transform& new_transform) {
+        CHECK(new_transform.crop.offset.x >= 0 && new_transform.crop.offset.y >= 0, "Crop offset cannot be negative.");
+        {
+                std::scoped_lock lock(transform_mutex);
+                transform = new_transform;
+        }
+        // the kept image is redrawn with the new transform
+        request_redraw();
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_color_lut(const color_lut_data& lut, lut_interpolation interpolation) {
+        CHECK(lut.size >= 2 && lut.size <= color_lut::max_size, "Unsupported size of the color LUT.");
+        CHECK(lut.rgb.size() == size_t{ lut.size } * lut.size * lut.size * 3, "Color LUT must have size^3 entries.");
+        // the LUT is converted here, the display thread only uploads it
+        color_lut.set(lut);
+        color_lut_interpolation = interpolation;
+        color_lut_enabled = true;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_keep_last_image(bool enabled) {
+        // zero count means the display isn't initialised yet, init checks the count then
+        CHECK(!enabled || min_transfer_image_count == 0 || min_transfer_image_count >= 2,
+                "Keeping the last image needs at least two transfer images.");
+        keep_last_image = enabled;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::set_low_latency_mode(bool enabled) {
+        std::scoped_lock lock(device_mutex);
+        low_latency_mode = enabled;
+        if (context.low_latency != enabled) {
+                context.low_latency = enabled;
+                auto parameters = context.get_window_parameters();
+                if (parameters.width * parameters.height != 0) {
+                        PASS_RESULT(context.recreate_swapchain(parameters, render_pass));
+                }
+        }
         return RETURN_TYPE();
 }
 
 RETURN_TYPE vulkan_display::window_parameters_changed(window_parameters new_parameters) {
+        {
+                std::scoped_lock lock(device_mutex);
+                PASS_RESULT(update_window_parameters(new_parameters));
+        }
+        request_redraw();
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE vulkan_display::update_window_parameters(window_parameters new_parameters) {
         if (new_parameters != context.get_window_parameters() && new_parameters.width * new_parameters.height != 0) {
-                context.recreate_swapchain(new_parameters, render_pass);
+                PASS_RESULT(context.recreate_swapchain(new_parameters, render_pass));
                 update_render_area_viewport_scissor(render_area, viewport, scissor,
-                        { new_parameters.width, new_parameters.height }, current_image_description.size);
+                        { new_parameters.width, new_parameters.height }, current_image_description.size,
+                        render_area_transform, render_area_filter == scaling_filter::integer);
         }
         return RETURN_TYPE();
 }
@@ -1,10 +1,22 @@
 #pragma once
 
 #include "concurent_queue.h"
+#include "frame_trace.h"
+#include "vulkan_color_lut.h"
 #include "vulkan_context.h"
+#include "vulkan_deinterlacer.h"
+#include "vulkan_mipmap_image.h"
+#include "preprocess_pool.h"
+#include "transfer_pool_sizer.h"
+#include "vulkan_readback.h"
+#include "vulkan_tiled_image.h"
 #include "vulkan_transfer_image.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <mutex>
+#include <optional>
 #include <utility>
 
 namespace vulkan_display_detail {
@@ -16,6 +28,206 @@ struct render_area {
         uint32_t height;
 };
 
+struct fragment_push_constants {
+        render_area area;
+        float alpha = 1.f;
+        uint32_t lut_mode = 0; // 0 disables the LUT, otherwise value of lut_interpolation + 1
+        uint32_t lut_srgb = 0; // 1 if the image is sampled linearized, the LUT is applied to sRGB encoded values
+        float lut_size = 0.f;
+        std::array<float, 3> lut_domain_min{};
+        std::array<float, 3> lut_domain_scale{};
+        // rows of the affine map from the render area coordinates to the texture coordinates
+        std::array<float, 3> uv_transform_x{ 1.f, 0.f, 0.f };
+        std::array<float, 3> uv_transform_y{ 0.f, 1.f, 0.f };
+};
+
+} // vulkan_display_detail
+
+namespace vulkan_display {
+
+/**
+ * Filter used for scaling the image to the render area, every filter has its own pipeline,
+ * so it can be switched between frames without recreating anything.
+ */
+enum class scaling_filter : uint32_t {
+        nearest,
+        integer,        ///< nearest filter with the image scaled by an integer factor if it fits into the window
+        bilinear,
+        bicubic,        ///< Catmull-Rom
+        lanczos3,
+        edge_adaptive,  ///< bicubic with additional smoothing along edges, intended for upscaling
+        count
+};
+
+constexpr size_t scaling_filter_count = static_cast<size_t>(scaling_filter::count);
+
+struct gpu_time_statistics {
+        uint64_t frame_count = 0;
+        double total_ms = 0.0;
+        double last_ms = 0.0;
+
+        double average_ms() const {
+                return frame_count == 0 ? 0.0 : total_ms / frame_count;
+        }
+};
+
+/// why try_acquire_image or acquire_image_for returned without an image
+enum class acquire_refusal {
+        none,
+        pool_exhausted, ///< all transfer images are held by producers or queued for the display
+        gpu_busy,       ///< an image was available, but the gpu didn't finish the frame which displayed it
+        memory_limit,   ///< new allocation would exceed transfer_memory_limit or the heap budget even without cached ones
+};
+
+/**
+ * Latency from queue_image until the gpu finished the frame, presentation itself isn't included.
+ * The display thread waits for the frame right after submitting it and takes the end when the wait finishes,
+ * so the time until the next display call doesn't add to it.
+ */
+struct latency_statistics {
+        uint64_t frame_count = 0;
+        uint64_t skipped_frames = 0;    ///< queued images replaced by a newer image before they were displayed
+        double total_ms = 0.0;
+        double last_ms = 0.0;
+        double max_ms = 0.0;
+
+        double average_ms() const {
+                return frame_count == 0 ? 0.0 : total_ms / frame_count;
+        }
+};
+
+struct mipmap_statistics {
+        gpu_time_statistics gpu_time;   ///< gpu time of frames rendered with generated mip chain
+        uint64_t generated_bytes = 0;   ///< bytes written to the device local memory by the mip generation
+};
+
+/// compared with gpu time of the same scaling filter without the LUT it gives the cost of the LUT
+struct color_lut_statistics {
+        gpu_time_statistics gpu_time;   ///< gpu time of frames rendered with the LUT applied
+        uint64_t uploaded_luts = 0;
+        uint64_t uploaded_bytes = 0;
+};
+
+/**
+ * Host buffers, gpu frames in flight and swapchain images are set independently,
+ * latency sensitive applications can use few frames in flight with many transfer images and vice versa
+ */
+struct display_parameters {
+        uint32_t transfer_image_count = 3;      ///< images which can be filled by producers or queued at once
+        uint32_t frames_in_flight = 2;          ///< frames submitted before the display thread waits for the gpu
+        uint32_t swapchain_image_count = 0;     ///< clamped to the surface limits, 0 selects minimal count + 1
+        uint32_t cached_image_count = 4;        ///< spare allocations kept for reuse when the image size changes
+        vk::DeviceSize transfer_memory_limit = 0; ///< bytes of transfer images and cached allocations, 0 is unlimited
+        uint32_t min_transfer_image_count = 1;  ///< lower bound of the adaptive pool, transfer_image_count is the initial count
+        uint32_t max_transfer_image_count = 0;  ///< upper bound of the adaptive pool, 0 disables adaptive sizing
+};
+
+constexpr uint32_t max_overlay_count = 8;
+
+/**
+ * Position and size are relative to the area where the video is rendered, so overlays stay on the same place
+ * of the video when the window is resized
+ */
+struct overlay_parameters {
+        float x = 0.f;
+        float y = 0.f;
+        float width = 1.f;
+        float height = 1.f;
+        float alpha = 1.f;      ///< multiplies the alpha channel of the overlay image
+        int z_order = 0;        ///< overlays with higher z_order are drawn over overlays with lower z_order
+        bool visible = true;
+};
+
+enum class image_rotation : uint32_t {
+        none,
+        clockwise_90,
+        clockwise_180,
+        clockwise_270,
+};
+
+/**
+ * Applied by the shader while the image is sampled, so the image isn't copied. The image is cropped first,
+ * then rotated and the rotated image is flipped.
+ */
+struct image_transform {
+        vk::Rect2D crop{};              ///< source rectangle in pixels, zero extent uses the whole image
+        image_rotation rotation = image_rotation::none;
+        bool flip_horizontal = false;
+        bool flip_vertical = false;
+
+        bool operator==(const image_transform& other) const {
+                return crop == other.crop && rotation == other.rotation &&
+                        flip_horizontal == other.flip_horizontal && flip_vertical == other.flip_vertical;
+        }
+
+        bool operator!=(const image_transform& other) const {
+                return !(*this == other);
+        }
+};
+
+constexpr uint32_t max_mosaic_stream_count = 16;
+constexpr uint32_t max_mosaic_stream_image_count = 6;
+
+/// tiles are numbered row by row, spacing separates tiles from each other and from the window borders
+struct mosaic_layout {
+        uint32_t columns = 2;
+        uint32_t rows = 2;
+        uint32_t spacing = 2;   ///< pixels
+};
+
+/// what happens with a frame queued while the previous frame of the stream still waits for the display
+enum class stream_drop_policy {
+        drop_oldest,    ///< the waiting frame is replaced, the tile shows the newest frame
+        drop_newest,    ///< the queued frame is discarded, frames are shown in order as long as the display keeps up
+};
+
+struct mosaic_stream_parameters {
+        uint32_t tile = 0;
+        uint32_t image_count = 3;       ///< at least 3, the producer can hold image_count - 2 images at once
+        stream_drop_policy drop_policy = stream_drop_policy::drop_oldest;
+        image_transform transform{};    ///< applied to the images of the stream like set_image_transform
+};
+
+struct mosaic_stream_statistics {
+        uint64_t queued_frames = 0;
+        uint64_t displayed_frames = 0;  ///< queued frames drawn in at least one mosaic frame, hidden tiles aren't drawn
+        uint64_t dropped_frames = 0;    ///< frames dropped by the drop policy before they were drawn
+};
+
+} // vulkan_display
+
+namespace vulkan_display_detail {
+
+struct overlay {
+        bool created = false;
+        vulkan_display::overlay_parameters parameters{};
+
+        // front image is drawn, back image is filled by the producer
+        std::array<transfer_image, 2> images{};
+        std::array<vk::DescriptorSet, 2> descriptor_sets{};
+        std::array<uint64_t, 2> last_used_frame{}; // last frame sampling the image, 0 if none
+        uint32_t front = 0;
+        bool front_filled = false;
+        bool front_changed = false; // host writes to the front image weren't made visible to the gpu yet
+};
+
+/// images of the stream not drawn or waiting for the display belong to the producer
+struct mosaic_stream {
+        static constexpr uint32_t no_image = UINT32_MAX;
+        static constexpr uint32_t max_image_count = vulkan_display::max_mosaic_stream_image_count;
+
+        bool created = false;
+        vulkan_display::mosaic_stream_parameters parameters{};
+        std::array<transfer_image, max_image_count> images{};
+        std::array<vk::DescriptorSet, max_image_count> descriptor_sets{};
+        std::array<uint64_t, max_image_count> last_used_frame{}; // last frame sampling the image, 0 if none
+        std::array<bool, max_image_count> acquired{};
+        uint32_t front = no_image;      // drawn in every mosaic frame until a newer image is queued
+        uint32_t pending = no_image;    // queued image, it becomes the front image in the next mosaic frame
+        bool front_changed = false;
+        vulkan_display::mosaic_stream_statistics statistics{};
+};
+
 } // vulkan_display_detail
 
 namespace vulkan_display {
@@ -31,9 +243,13 @@ class vulkan_display {
         window_changed_callback* window = nullptr;
         vulkan_display_detail::vulkan_context context;
         vk::Device device;
+        // serializes the swapchain, the queue and the rendering state, producers never lock it,
+        // because transfer images are owned by one thread at a time and gpu waits don't need it
         std::mutex device_mutex{};
 
         vulkan_display_detail::render_area render_area{};
+        scaling_filter render_area_filter = scaling_filter::bilinear;
+        image_transform render_area_transform{};
         vk::Viewport viewport;
         vk::Rect2D scissor;
 
@@ -48,29 +264,125 @@ class vulkan_display {
         vk::DescriptorPool descriptor_pool;
         std::vector<vk::DescriptorSet> descriptor_sets{};
 
+        vulkan_display_detail::mipmap_image mipmap_image;
+        vk::DescriptorSet mipmap_descriptor_set;
+        std::atomic<bool> mipmapping_enabled = false;
+        std::atomic<double> mipmap_downscale_threshold = 2.0;
+
+        // deinterlaced image is sampled instead of interlaced transfer images
+        vulkan_display_detail::deinterlacer deinterlacer;
+        vk::ShaderModule deinterlace_shader;
+        vk::DescriptorSet deinterlace_descriptor_set;
+        std::atomic<deinterlace_mode> deinterlacing = deinterlace_mode::bob;
+
+        // LUT has its own descriptor set bound next to the image, so it's swapped without new pipelines
+        vulkan_display_detail::color_lut color_lut;
+        std::atomic<bool> color_lut_enabled = false;
+        std::atomic<lut_interpolation> color_lut_interpolation = lut_interpolation::tetrahedral;
+
         vk::PipelineLayout pipeline_layout;
-        vk::Pipeline pipeline;
+        std::array<vk::Pipeline, scaling_filter_count> pipelines{};
+        std::atomic<scaling_filter> filter = scaling_filter::bilinear;
+        std::mutex transform_mutex{};
+        image_transform transform{}; // protected by transform_mutex, render_area_transform is the applied one
+        vk::Pipeline overlay_pipeline;
 
         vk::CommandPool command_pool;
-        std::vector<vk::CommandBuffer> command_buffers{};
 
+        // two timestamps for every frame slot, gpu time is read before the slot is recorded again
+        vk::QueryPool timestamp_pool;
+        double timestamp_period_ms = 0.0;
+        struct timestamp_slot {
+                bool written = false;
+                bool mipmapped = false;
+                scaling_filter filter{};
+                bool lut_applied = false;
+        };
+        std::mutex statistics_mutex{};
+        std::array<gpu_time_statistics, scaling_filter_count> filter_statistics{};
+        mipmap_statistics mipmap_frame_statistics{};
+        color_lut_statistics lut_frame_statistics{};
+
+        std::atomic<bool> low_latency_mode = false;
+        latency_statistics frame_latency_statistics{};
 
-        struct image_semaphores {
+        // state of one frame in flight, it is reused after the gpu finishes the previous frame of the slot
+        struct frame_slot {
+                vk::CommandBuffer command_buffer;
                 vk::Semaphore image_acquired;
                 vk::Semaphore image_rendered;
+                uint64_t frame_number = 0; // value of the queue timeline signaled by the last submission
+                timestamp_slot timestamp{};
         };
-        std::vector<image_semaphores> image_semaphores;
-
+        std::vector<frame_slot> frame_slots{};
+        uint32_t frame_slot_id = 0;
+
+        // tiled image is rendered instead of the queued images, it has its own frames in flight
+        vulkan_display_detail::tiled_image tiled_image;
+        vk::ShaderModule tile_vertex_shader;
+        vk::ShaderModule tile_fragment_shader;
+        std::array<frame_slot, vulkan_display_detail::tiled_image::frame_slot_count> tiled_frames{};
+        uint32_t tiled_frame_id = 0;
+        std::mutex tiled_view_mutex{};
+        tiled_view current_tiled_view{};
 
         using transfer_image = vulkan_display_detail::transfer_image;
-        unsigned transfer_image_count = 0;
+        unsigned transfer_image_count = 0; // all created transfer images, including the retired ones
+        unsigned min_transfer_image_count = 0; // the adaptive pool never retires images below this count
         std::vector<transfer_image> transfer_images{};
+        vulkan_display_detail::transfer_image_cache image_cache;
+
+        // images are retired and added by producers in acquire_image, so the display thread never waits for it
+        bool adaptive_transfer_pool = false;
+        vulkan_display_detail::transfer_pool_sizer pool_sizer;
+        std::mutex retired_images_mutex{};
+        std::vector<transfer_image*> retired_images{};
         image_description current_image_description;
 
+        uint64_t submitted_frame_count = 0;
+
+        std::mutex overlay_mutex{};
+        std::array<vulkan_display_detail::overlay, max_overlay_count> overlays{};
+        struct overlay_draw {
+                vk::DescriptorSet descriptor_set;
+                overlay_parameters parameters;
+        };
+        std::vector<overlay_draw> overlay_draws{}; // used only by the thread calling display_queued_image
+
+        // mosaic draws the newest image of every stream, streams and the layout are protected by mosaic_mutex
+        std::mutex mosaic_mutex{};
+        mosaic_layout current_mosaic_layout{};
+        std::array<vulkan_display_detail::mosaic_stream, max_mosaic_stream_count> mosaic_streams{};
+        struct mosaic_draw {
+                vk::DescriptorSet descriptor_set;
+                vk::Format format;
+                vk::Extent2D image_size;
+                image_transform transform;
+                vulkan_display_detail::render_area area;
+                vk::Viewport viewport;
+                vk::Rect2D scissor;
+        };
+        std::vector<mosaic_draw> mosaic_draws{}; // used only by the thread calling display_mosaic
+
+        vulkan_display_detail::readback_ring readback;
+
+        std::mutex preprocess_mutex{};
+        std::vector<std::pair<vk::Format, preprocess_function>> format_preprocess_functions{};
+
         concurrent_queue<transfer_image*> available_img_queue{};
         concurrent_queue<image> filled_img_queue{};
+        vulkan_display_detail::preprocess_pool preprocess_pool; // pushes to filled_img_queue, so it's destroyed first
+
+        std::atomic<unsigned> filled_img_max_count = 0;
+
+        // last displayed image is kept for redraws, producers get it back once a newer image is displayed
+        std::atomic<bool> keep_last_image = false;
+        // set under the lock of filled_img_queue, so the display thread waiting for an image cannot miss it
+        std::atomic<bool> redraw_requested = false;
+        transfer_image* last_image = nullptr; // used only by the thread calling display_queued_image
+        // deinterlaced image whose first field was presented, the next display call presents its second field
+        transfer_image* pending_second_field = nullptr;
 
-        unsigned filled_img_max_count = 0;
         bool minimalised = false;
         bool destroyed = false;
 private:
@@ -87,15 +399,95 @@ private:
 
         RETURN_TYPE create_command_pool();
 
-        RETURN_TYPE create_command_buffers();
+        /// allocates command buffers and semaphores of the slots
+        RETURN_TYPE create_frame_slots(frame_slot* slots, uint32_t slot_count);
 
-        RETURN_TYPE create_transfer_image(transfer_image*& result, image_description description);
+        RETURN_TYPE create_timestamp_pool();
 
-        RETURN_TYPE create_image_semaphores();
+        RETURN_TYPE collect_gpu_time(uint32_t slot_id);
+
+        RETURN_TYPE create_transfer_image(transfer_image*& result, image_description description);
 
         RETURN_TYPE allocate_description_sets();
 
-        RETURN_TYPE record_graphics_commands(transfer_image& transfer_image, uint32_t swapchain_image_id);
+        RETURN_TYPE update_mipmap_image(bool& use_mipmaps, image_description description);
+
+        /// device_mutex has to be locked, the deinterlacer is created with the first interlaced image
+        RETURN_TYPE update_deinterlacer(bool& use_deinterlacer, const transfer_image& transfer_image);
+
+        bool is_deinterlaced(const transfer_image& transfer_image) const {
+                return transfer_image.field_order != field_order::progressive && deinterlacing != deinterlace_mode::weave;
+        }
+
+        /// without a deadline the function waits until an image is available, only memory_limit is refused then
+        RETURN_TYPE acquire_image_until(image& image, image_description description,
+                std::optional<std::chrono::steady_clock::time_point> deadline, acquire_refusal& refusal);
+
+        /// retires the image acquired by the producer or adds a retired one as decided by pool_sizer
+        void resize_transfer_pool(transfer_image& acquired_image, int change, bool& acquired_image_retired);
+
+        /// returns nothing if the deadline passed or a redraw of the kept image was requested first
+        std::optional<image> pop_filled_image(std::optional<std::chrono::steady_clock::time_point> deadline);
+
+        /// wakes the display thread waiting for a queued image, so the kept image is drawn again
+        void request_redraw();
+
+        /// waits until the gpu finishes the submitted frame and adds the time since the image was queued to the statistics
+        RETURN_TYPE record_frame_latency(uint64_t frame_number, std::chrono::steady_clock::time_point queue_time);
+
+        /// replaces the image by the newest queued one, the previous frame has to be finished by the gpu
+        void pick_latest_image(image& image);
+
+        /// calls preprocess function of the image or the function registered for its format
+        void preprocess_image(image& image);
+
+        /// device_mutex has to be locked, swapchain_image_id is SWAPCHAIN_IMAGE_OUT_OF_DATE if the window is minimalised
+        RETURN_TYPE acquire_swapchain_image(uint32_t& swapchain_image_id, vk::Semaphore image_acquired);
+
+        RETURN_TYPE present_swapchain_image(uint32_t swapchain_image_id, vk::Semaphore image_rendered);
+
+        /// device_mutex has to be locked
+        RETURN_TYPE update_window_parameters(window_parameters new_parameters);
+
+        /// waits until the gpu finishes the frame, frame numbers are values of the queue timeline semaphore
+        RETURN_TYPE wait_for_frame(uint64_t frame_number) {
+                vulkan_display_detail::trace_scope trace{ "wait_for_frame", frame_number };
+                return vulkan_display_detail::wait_for_timeline_value(device, context.queue_timeline, frame_number);
+        }
+
+        /// signals image_rendered and the queue timeline with value frame_number
+        RETURN_TYPE submit_frame(vk::CommandBuffer cmd_buffer, vk::Semaphore image_acquired, vk::Semaphore image_rendered,
+                uint64_t frame_number);
+
+        /// records barriers for changed overlays and fills overlay_draws with visible overlays sorted by z_order
+        void prepare_overlays(vk::CommandBuffer cmd_buffer, uint64_t frame_number);
+
+        void record_overlay_draws(vk::CommandBuffer cmd_buffer);
+
+        /// fills push constants of the LUT for the drawn image, returns false if the LUT is disabled
+        bool set_color_lut_constants(vulkan_display_detail::fragment_push_constants& constants, vk::Format image_format);
+
+        /// takes the newest queued images of the streams and fills mosaic_draws with tiles of the current layout
+        void prepare_mosaic(vk::CommandBuffer cmd_buffer, uint64_t frame_number);
+
+        /**
+         * Redraw of a staged image skips its upload, the image already holds the frame.
+         * Field is the index of the displayed field in time if the image is deinterlaced,
+         * a redraw samples the deinterlaced output without dispatching the deinterlacer.
+         */
+        RETURN_TYPE record_graphics_commands(uint32_t slot_id, transfer_image& transfer_image, uint32_t swapchain_image_id,
+                bool mipmapped, vulkan_display_detail::readback_ring::buffer* capture_buffer, bool redraw,
+                std::optional<uint32_t> field);
+
+        /// without a deadline the function waits until an image is queued
+        RETURN_TYPE display_queued_image_until(bool& displayed,
+                std::optional<std::chrono::steady_clock::time_point> deadline);
+
+        /// displayed is false if the swapchain is out of date, the image then isn't presented
+        RETURN_TYPE render_image(bool& displayed, transfer_image& transfer_image, bool redraw, uint32_t field = 0);
+
+        /// displayed image is kept for redraws or given back to producers
+        void release_displayed_image(transfer_image& transfer_image);
 
 public:
         vulkan_display() = default;
@@ -133,13 +525,42 @@ public:
                 return context.get_available_gpus(gpus);
         }
 
-        RETURN_TYPE init(VkSurfaceKHR surface, uint32_t transfer_image_count,
+        RETURN_TYPE init(VkSurfaceKHR surface, display_parameters parameters,
                 window_changed_callback* window, uint32_t gpu_index = NO_GPU_SELECTED);
 
+        /// every transfer image can be in flight, swapchain has the default image count
+        RETURN_TYPE init(VkSurfaceKHR surface, uint32_t transfer_image_count,
+                window_changed_callback* window, uint32_t gpu_index = NO_GPU_SELECTED)
+        {
+                return init(surface, display_parameters{ transfer_image_count, transfer_image_count, 0 }, window, gpu_index);
+        }
+
         RETURN_TYPE destroy();
 
+        /**
+         * @brief BC1, BC3 and BC7 formats are supported if the gpu can sample them, their images are uploaded
+         *  from a staging buffer and the row pitch of the acquired image is the size of one row of 4x4 blocks
+         */
+        bool is_image_format_supported(vk::Format format);
+
+        /**
+         * waits until an image is available, which can take long while the display is stalled,
+         * fails if the image doesn't fit into the memory limit or the heap budget
+         */
         RETURN_TYPE acquire_image(image& image, image_description description);
 
+        /// returns an empty image and the reason in refusal if no image can be acquired without waiting
+        RETURN_TYPE try_acquire_image(image& image, image_description description, acquire_refusal& refusal) {
+                return acquire_image_until(image, description, std::chrono::steady_clock::now(), refusal);
+        }
+
+        /// returns an empty image and the reason in refusal if no image can be acquired within the timeout
+        RETURN_TYPE acquire_image_for(image& image, image_description description,
+                std::chrono::steady_clock::duration timeout, acquire_refusal& refusal)
+        {
+                return acquire_image_until(image, description, std::chrono::steady_clock::now() + timeout, refusal);
+        }
+
         RETURN_TYPE queue_image(image img);
 
         RETURN_TYPE copy_and_queue_image(std::byte* frame, image_description description);
@@ -153,6 +574,255 @@ public:
 
         RETURN_TYPE display_queued_image();
 
+        /**
+         * @brief Waits for a queued image at most for the timeout, so the display thread can check for shutdown.
+         *  When no image comes and the window changed, the kept last image is drawn again if keep_last_image is set.
+         */
+        RETURN_TYPE display_queued_image_for(bool& displayed, std::chrono::steady_clock::duration timeout) {
+                return display_queued_image_until(displayed, std::chrono::steady_clock::now() + timeout);
+        }
+
+        /**
+         * @brief The last displayed image stays out of the pool, so expose and resize can redraw it
+         *  with the new viewport without a new frame from the producer.
+         *  Producers need another image meanwhile, so the pool must never have less than two images.
+         */
+        RETURN_TYPE set_keep_last_image(bool enabled);
+
+        /**
+         * @brief Images with field order set by image::set_field_order are deinterlaced on the gpu,
+         *  mipmapping is not used for them.
+         *  Bob and motion adaptive modes present the second field by the next call of display_queued_image,
+         *  which then doesn't take a queued image, so fields are paced by the display loop. FIFO present modes
+         *  (vsync) pace them by the refresh rate, which has to equal the field rate, e.g. 50 Hz for 25
+         *  interlaced frames per second. Mailbox and immediate modes present at once, the caller has to call
+         *  display_queued_image at the field rate itself.
+         */
+        void set_deinterlace_mode(deinterlace_mode mode) {
+                deinterlacing = mode;
+        }
+
+        /**
+         * @brief Queued images are preprocessed by thread_count worker threads instead of the thread calling
+         *  display_queued_image, frames are displayed in the order they were queued.
+         *  Zero thread count preprocesses images in display_queued_image.
+         *  Cannot be called concurrently with queue_image.
+         */
+        void set_preprocess_thread_count(uint32_t thread_count);
+
+        /**
+         * @brief Preprocess function is called for every frame of the format without its own function,
+         *  so it doesn't have to be set for every frame. Passing nullptr removes the function.
+         */
+        void set_format_preprocess_function(vk::Format format, preprocess_function function);
+
+        /**
+         * @brief Image larger than the gpu limits is split into tiles, only visible tiles are uploaded
+         *  into the cache of fixed size. Passing nullptr releases the cache. Source has to stay valid until it is replaced
+         *  or the display is destroyed, queued images shouldn't be displayed while the tiled image is used.
+         */
+        RETURN_TYPE set_tiled_image(tile_source* source, tiled_image_parameters parameters = {});
+
+        /// can be called from any thread, applied from the next displayed frame
+        void set_tiled_view(tiled_view view) {
+                std::scoped_lock lock(tiled_view_mutex);
+                current_tiled_view = view;
+        }
+
+        RETURN_TYPE display_tiled_image();
+
+        /**
+         * @brief Mosaic draws the newest frame of every stream into its tile of the grid in one render pass,
+         *  display_mosaic is called once per displayed frame instead of display_queued_image.
+         *  Streams have their own images, so a stalled stream only keeps showing its last frame.
+         *  Overlays, deinterlacing and set_image_transform aren't applied to the mosaic, the color LUT is,
+         *  every stream has its own transform in its parameters.
+         */
+        RETURN_TYPE set_mosaic_layout(mosaic_layout layout);
+
+        RETURN_TYPE create_mosaic_stream(uint32_t& stream_id, mosaic_stream_parameters parameters = {});
+
+        /// images of the stream are kept allocated and reused by the next created stream
+        RETURN_TYPE destroy_mosaic_stream(uint32_t stream_id);
+
+        /// can be called from any thread, the stream is moved from the next displayed frame
+        RETURN_TYPE set_mosaic_stream_tile(uint32_t stream_id, uint32_t tile);
+
+        /// can be called from any thread, the transform is applied from the next displayed frame
+        RETURN_TYPE set_mosaic_stream_transform(uint32_t stream_id, const image_transform& transform);
+
+        /**
+         * @brief Waits only for the gpu frame which last sampled the acquired image, never for the display thread.
+         *  Acquiring fails if the producers of the stream already hold image_count - 2 images.
+         */
+        RETURN_TYPE acquire_mosaic_image(uint32_t stream_id, image& image, image_description description);
+
+        RETURN_TYPE queue_mosaic_image(uint32_t stream_id, image image);
+
+        RETURN_TYPE copy_and_queue_mosaic_image(uint32_t stream_id, std::byte* frame, image_description description);
+
+        /// displayed is false if the window is minimised or the swapchain is out of date
+        RETURN_TYPE display_mosaic(bool& displayed);
+
+        RETURN_TYPE get_mosaic_stream_statistics(mosaic_stream_statistics& statistics, uint32_t stream_id);
+
+        /**
+         * @brief Overlays are blended over the video in the same render pass,
+         *  overlay image is uploaded only when a new one is queued and it is drawn in every frame until replaced
+         */
+        RETURN_TYPE create_overlay(uint32_t& overlay_id, overlay_parameters parameters = {});
+
+        /// overlay images are kept allocated and reused by the next created overlay
+        RETURN_TYPE destroy_overlay(uint32_t overlay_id);
+
+        RETURN_TYPE set_overlay_parameters(uint32_t overlay_id, overlay_parameters parameters);
+
+        /**
+         * @brief Only one thread can acquire and queue images of one overlay at a time,
+         *  waits until the gpu stops using the acquired image
+         */
+        RETURN_TYPE acquire_overlay_image(uint32_t overlay_id, image& image, image_description description);
+
+        RETURN_TYPE queue_overlay_image(uint32_t overlay_id, image image);
+
+        RETURN_TYPE copy_and_queue_overlay_image(uint32_t overlay_id, std::byte* frame, image_description description);
+
+        /**
+         * @brief Filter is applied from the next displayed frame, can be called from any thread
+         */
+        void set_scaling_filter(scaling_filter filter) {
+                this->filter = filter;
+        }
+
+        scaling_filter get_scaling_filter() const {
+                return filter;
+        }
+
+        /**
+         * @brief Crop, rotation and flips are applied from the next displayed frame, the render area
+         *  keeps the aspect ratio of the transformed image. Can be called from any thread.
+         */
+        RETURN_TYPE set_image_transform(const image_transform& new_transform);
+
+        /**
+         * @brief 3D LUT is uploaded with the first displayed frame after the gpu finishes the frames sampling
+         *  the LUT before the current one, until then the current LUT is applied. Overlays stay unchanged.
+         *  Images with sRGB formats are looked up by their sRGB encoded values like the other images.
+         *  Can be called from any thread, pipelines aren't recreated.
+         */
+        RETURN_TYPE set_color_lut(const color_lut_data& lut, lut_interpolation interpolation = lut_interpolation::tetrahedral);
+
+        void set_color_lut_interpolation(lut_interpolation interpolation) {
+                color_lut_interpolation = interpolation;
+        }
+
+        void disable_color_lut() {
+                color_lut_enabled = false;
+        }
+
+        /**
+         * @brief When enabled and the image is downscaled more than downscale_threshold times,
+         *  mip chain of the image is generated on the gpu and sampled with trilinear filter instead of scaling_filter
+         */
+        void set_mipmapping(bool enabled, double downscale_threshold = 2.0) {
+                mipmap_downscale_threshold = downscale_threshold;
+                mipmapping_enabled = enabled;
+        }
+
+        /**
+         * @brief Gpu time of the rendering measured by timestamp queries for every filter separately,
+         *  frame_count stays zero if the queue doesn't support timestamps
+         */
+        gpu_time_statistics get_gpu_time_statistics(scaling_filter filter) {
+                std::scoped_lock lock(statistics_mutex);
+                return filter_statistics[static_cast<size_t>(filter)];
+        }
+
+        mipmap_statistics get_mipmap_statistics() {
+                std::scoped_lock lock(statistics_mutex);
+                return mipmap_frame_statistics;
+        }
+
+        /// frames with the LUT applied are counted only here, not in the filter or mipmap statistics
+        color_lut_statistics get_color_lut_statistics() {
+                std::scoped_lock lock(statistics_mutex);
+                return lut_frame_statistics;
+        }
+
+        /**
+         * @brief Low latency mode uses the smallest swapchain allowed by the surface, display_queued_image
+         *  waits until the gpu finishes every frame it submits, so only one frame is in flight whatever
+         *  frames_in_flight is, and displays only the newest queued image, older queued images are discarded.
+         *  Swapchain is recreated when the mode changes.
+         */
+        RETURN_TYPE set_low_latency_mode(bool enabled);
+
+        /**
+         * @brief acquire_image prefers available images of the requested description, the others are reused
+         *  from the cache. Cached allocations are released when the memory limit or the heap budget is reached,
+         *  an image which doesn't fit even then is refused with acquire_refusal::memory_limit.
+         */
+        image_cache_statistics get_image_cache_statistics() const {
+                return image_cache.get_statistics();
+        }
+
+        /**
+         * @brief With max_transfer_image_count set, the number of transfer images grows when producers wait
+         *  for available images and shrinks when images stay unused or the display drops frames
+         */
+        transfer_pool_statistics get_transfer_pool_statistics() {
+                return pool_sizer.get_statistics();
+        }
+
+        /// usage of the whole process, budget is reported only if the gpu supports VK_EXT_memory_budget
+        void get_memory_heap_usage(std::vector<memory_heap_usage>& heaps) const {
+                context.get_memory_heap_usage(heaps);
+        }
+
+        /// latency is measured only in low latency mode, where the display thread waits for every frame
+        latency_statistics get_latency_statistics() {
+                std::scoped_lock lock(statistics_mutex);
+                return frame_latency_statistics;
+        }
+
+        /**
+         * @brief Presented frames of display_queued_image are copied into a ring of buffer_count host visible buffers
+         *  and delivered to the callback on a worker thread. The display thread never waits for the consumer,
+         *  frames are dropped if all buffers are still used. Swapchain is recreated when called for the first time.
+         */
+        RETURN_TYPE start_frame_capture(frame_capture_callback* callback, uint32_t buffer_count = 3);
+
+        /// after the function returns, the callback is not called anymore
+        void stop_frame_capture() {
+                readback.set_callback(nullptr);
+        }
+
+        /**
+         * @brief Frame number of the last frame finished by the gpu, it is read from the queue timeline semaphore
+         *  without waiting, image displayed in the frame and all earlier frames can be reused
+         */
+        RETURN_TYPE get_completed_frame_number(uint64_t& frame_number) {
+                CHECKED_ASSIGN(frame_number, device.getSemaphoreCounterValue(context.queue_timeline));
+                return RETURN_TYPE();
+        }
+
+        /**
+         * @brief Records events of the frame pipeline with frame numbers, thread ids and nanosecond timestamps.
+         *  Tracing is process wide and events of the previous trace are dropped.
+         */
+        void start_tracing() {
+                vulkan_display_detail::frame_tracer::start();
+        }
+
+        /// events are written as Chrome trace-event JSON
+        RETURN_TYPE stop_tracing(const std::filesystem::path& path) {
+                return vulkan_display_detail::frame_tracer::stop(path);
+        }
+
+        capture_statistics get_capture_statistics() const {
+                return readback.get_statistics();
+        }
+
         /**
          * @brief Hint to vulkan display that some window parameters spicified in struct Window_parameters changed
          */
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "vulkan_display.h"
+
+// helpers of vulkan_display.cpp used by the benchmarks, applications include only vulkan_display.h
+
+namespace vulkan_display_detail {
+
+/// fits the transformed image into the window, integer scaling is used only if the image fits at least once
+RETURN_TYPE update_render_area_viewport_scissor(render_area& render_area, vk::Viewport& viewport, vk::Rect2D& scissor,
+        vk::Extent2D window_size, vk::Extent2D image_size, const vulkan_display::image_transform& transform,
+        bool integer_scaling = false);
+
+/**
+ * Prefers available images of the description, then any available image, takes the oldest queued image
+ * if filled_img_queue has more than filled_img_max_count images, otherwise waits for an available image.
+ * dropped is set if a queued image was taken. Returns nullptr if no image became available until the deadline.
+ */
+transfer_image* acquire_transfer_image(concurrent_queue<transfer_image*>& available_img_queue,
+        concurrent_queue<vulkan_display::image>& filled_img_queue, unsigned filled_img_max_count,
+        vulkan_display::image_description description,
+        std::optional<std::chrono::steady_clock::time_point> deadline, bool& dropped);
+
+} // vulkan_display_detail
@@ -0,0 +1,182 @@
+#include "vulkan_mipmap_image.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+using namespace vulkan_display_detail;
+
+namespace {
+
+vk::Offset3D level_extent(vk::Extent2D size, uint32_t level) {
+        return vk::Offset3D{
+                static_cast<int32_t>(std::max(size.width >> level, 1u)),
+                static_cast<int32_t>(std::max(size.height >> level, 1u)),
+                1 };
+}
+
+vk::ImageMemoryBarrier create_level_barrier(vk::Image image, uint32_t base_level, uint32_t level_count,
+        vk::ImageLayout old_layout, vk::ImageLayout new_layout,
+        vk::AccessFlags old_access, vk::AccessFlags new_access)
+{
+        vk::ImageMemoryBarrier memory_barrier{};
+        memory_barrier
+                .setImage(image)
+                .setOldLayout(old_layout)
+                .setNewLayout(new_layout)
+                .setSrcAccessMask(old_access)
+                .setDstAccessMask(new_access)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        memory_barrier.subresourceRange
+                .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                .setBaseMipLevel(base_level)
+                .setLevelCount(level_count)
+                .setLayerCount(1);
+        return memory_barrier;
+}
+
+} //namespace -------------------------------------------------------------
+
+namespace vulkan_display_detail {
+
+bool mipmap_image::is_format_supported(vk::PhysicalDevice gpu, vk::Format format) {
+        using bits = vk::FormatFeatureFlagBits;
+        auto required = bits::eBlitSrc | bits::eBlitDst | bits::eSampledImage | bits::eSampledImageFilterLinear;
+        auto features = gpu.getFormatProperties(format).optimalTilingFeatures;
+        return (features & required) == required;
+}
+
+uint32_t mipmap_image::get_mip_level_count(vk::Extent2D size, double downscale_ratio) {
+        auto full_chain = static_cast<uint32_t>(std::floor(std::log2(std::max(size.width, size.height)))) + 1;
+        // trilinear filter blends the level below and above the ideal level
+        auto needed = static_cast<uint32_t>(std::ceil(std::log2(std::max(downscale_ratio, 1.0)))) + 1;
+        return std::min(needed, full_chain);
+}
+
+RETURN_TYPE mipmap_image::create(vk::Device device, vk::PhysicalDevice gpu,
+        vulkan_display::image_description description, uint32_t mip_levels)
+{
+        destroy(device);
+
+        this->description = description;
+        this->mip_levels = mip_levels;
+        this->update_desciptor_set = true;
+
+        vk::ImageCreateInfo image_info;
+        image_info
+                .setImageType(vk::ImageType::e2D)
+                .setExtent(vk::Extent3D{ description.size, 1 })
+                .setMipLevels(mip_levels)
+                .setArrayLayers(1)
+                .setFormat(description.format)
+                .setTiling(vk::ImageTiling::eOptimal)
+                .setInitialLayout(vk::ImageLayout::eUndefined)
+                .setUsage(vk::ImageUsageFlagBits::eSampled
+                        | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setSamples(vk::SampleCountFlagBits::e1);
+        CHECKED_ASSIGN(image, device.createImage(image_info));
+
+        vk::MemoryRequirements memory_requirements = device.getImageMemoryRequirements(image);
+
+        uint32_t memory_type = 0;
+        PASS_RESULT(get_memory_type(memory_type, memory_requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags{}, gpu));
+
+        byte_size = memory_requirements.size;
+        vk::MemoryAllocateInfo allocInfo{ memory_requirements.size, memory_type };
+        CHECKED_ASSIGN(memory, device.allocateMemory(allocInfo));
+        PASS_RESULT(device.bindImageMemory(image, memory, 0));
+
+        vk::ImageViewCreateInfo view_info = vulkan_display::default_image_view_create_info(description.format);
+        view_info.setImage(image);
+        view_info.subresourceRange.setLevelCount(mip_levels);
+        CHECKED_ASSIGN(view, device.createImageView(view_info));
+        return RETURN_TYPE();
+}
+
+void mipmap_image::record_generation(vk::CommandBuffer cmd_buffer, vk::Image transfer_image) {
+        using layout = vk::ImageLayout;
+        using access = vk::AccessFlagBits;
+        using stage = vk::PipelineStageFlagBits;
+
+        // content of the previous frame is discarded, but it can be still sampled by the previous command buffer
+        auto discard_barrier = create_level_barrier(image, 0, mip_levels,
+                layout::eUndefined, layout::eTransferDstOptimal, access::eShaderRead, access::eTransferWrite);
+        cmd_buffer.pipelineBarrier(stage::eFragmentShader, stage::eTransfer,
+                vk::DependencyFlags{}, nullptr, nullptr, discard_barrier);
+
+        vk::ImageSubresourceLayers subresource{ vk::ImageAspectFlagBits::eColor, 0, 0, 1 };
+        vk::ImageCopy copy_region{ subresource, {0, 0, 0}, subresource, {0, 0, 0}, vk::Extent3D{ description.size, 1 } };
+        cmd_buffer.copyImage(transfer_image, layout::eTransferSrcOptimal, image, layout::eTransferDstOptimal, copy_region);
+
+        for (uint32_t level = 1; level < mip_levels; level++) {
+                auto source_barrier = create_level_barrier(image, level - 1, 1,
+                        layout::eTransferDstOptimal, layout::eTransferSrcOptimal, access::eTransferWrite, access::eTransferRead);
+                cmd_buffer.pipelineBarrier(stage::eTransfer, stage::eTransfer,
+                        vk::DependencyFlags{}, nullptr, nullptr, source_barrier);
+
+                vk::ImageBlit blit{};
+                blit.srcSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level - 1, 0, 1 };
+                blit.srcOffsets[1] = level_extent(description.size, level - 1);
+                blit.dstSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, level, 0, 1 };
+                blit.dstOffsets[1] = level_extent(description.size, level);
+                cmd_buffer.blitImage(image, layout::eTransferSrcOptimal, image, layout::eTransferDstOptimal,
+                        blit, vk::Filter::eLinear);
+        }
+
+        std::array<vk::ImageMemoryBarrier, 2> sample_barriers{
+                create_level_barrier(image, 0, mip_levels - 1,
+                        layout::eTransferSrcOptimal, layout::eShaderReadOnlyOptimal, access::eTransferRead, access::eShaderRead),
+                create_level_barrier(image, mip_levels - 1, 1,
+                        layout::eTransferDstOptimal, layout::eShaderReadOnlyOptimal, access::eTransferWrite, access::eShaderRead)
+        };
+        // if the chain has only one level, there are no levels in the layout eTransferSrcOptimal
+        auto barriers = vk::ArrayProxy<const vk::ImageMemoryBarrier>(mip_levels == 1 ? 1 : 2,
+                mip_levels == 1 ? &sample_barriers[1] : sample_barriers.data());
+        cmd_buffer.pipelineBarrier(stage::eTransfer, stage::eFragmentShader,
+                vk::DependencyFlags{}, nullptr, nullptr, barriers);
+}
+
+vk::DeviceSize mipmap_image::get_generated_byte_count() const {
+        // every level is written once by the copy or by the blit
+        return byte_size;
+}
+
+RETURN_TYPE mipmap_image::update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler) {
+        if (update_desciptor_set) {
+                update_desciptor_set = false;
+                vk::DescriptorImageInfo description_image_info;
+                description_image_info
+                        .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+                        .setSampler(sampler)
+                        .setImageView(view);
+
+                vk::WriteDescriptorSet descriptor_writes{};
+                descriptor_writes
+                        .setDstBinding(1)
+                        .setDstArrayElement(0)
+                        .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                        .setPImageInfo(&description_image_info)
+                        .setDescriptorCount(1)
+                        .setDstSet(descriptor_set);
+
+                device.updateDescriptorSets(descriptor_writes, nullptr);
+        }
+        return RETURN_TYPE();
+}
+
+void mipmap_image::destroy(vk::Device device) {
+        device.destroy(view);
+        device.destroy(image);
+        device.freeMemory(memory);
+        view = nullptr;
+        image = nullptr;
+        memory = nullptr;
+        mip_levels = 0;
+        byte_size = 0;
+        description = {};
+}
+
+} // vulkan_display_detail
@@ -0,0 +1,47 @@
+#pragma once
+#include "vulkan_context.h"
+#include "vulkan_transfer_image.h"
+
+namespace vulkan_display_detail {
+
+/**
+ * Device local image with mip chain generated from transfer image on the gpu,
+ * it is sampled instead of the transfer image when the image is downscaled a lot
+ */
+class mipmap_image {
+        vk::DeviceMemory memory;
+        vk::Image image;
+        vk::DeviceSize byte_size = 0;
+
+public:
+        vk::ImageView view;
+        vulkan_display::image_description description;
+        uint32_t mip_levels = 0;
+
+        bool update_desciptor_set = true;
+
+        /// returns true if mip chain of the format can be generated by vkCmdBlitImage
+        static bool is_format_supported(vk::PhysicalDevice gpu, vk::Format format);
+
+        /// mip levels needed for sampling with given downscale ratio with trilinear filter
+        static uint32_t get_mip_level_count(vk::Extent2D size, double downscale_ratio);
+
+        RETURN_TYPE create(vk::Device device, vk::PhysicalDevice gpu,
+                vulkan_display::image_description description, uint32_t mip_levels);
+
+        /**
+         * Copies the transfer image to the level 0 and blits all other levels,
+         * transfer image has to be in layout eTransferSrcOptimal.
+         * Image is in layout eShaderReadOnlyOptimal after the commands are executed.
+         */
+        void record_generation(vk::CommandBuffer cmd_buffer, vk::Image transfer_image);
+
+        /// bytes written by the gpu during one mip chain generation
+        vk::DeviceSize get_generated_byte_count() const;
+
+        RETURN_TYPE update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler);
+
+        void destroy(vk::Device device);
+};
+
+} // vulkan_display_detail
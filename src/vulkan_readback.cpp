@@ -0,0 +1,158 @@
+#include "vulkan_readback.h"
+
+#include <cassert>
+
+using namespace vulkan_display_detail;
+
+namespace vulkan_display_detail {
+
+RETURN_TYPE readback_ring::init(vk::Device device, vk::PhysicalDevice gpu, vk::Semaphore timeline, uint32_t buffer_count) {
+        assert(!is_initialised());
+        CHECK(buffer_count > 0, "At least one readback buffer is needed.");
+        this->device = device;
+        this->gpu = gpu;
+        this->timeline = timeline;
+
+        buffers.resize(buffer_count);
+        for (auto& buffer : buffers) {
+                free_buffers.push(&buffer);
+        }
+        worker = std::thread{ [this]() { run(); } };
+        return RETURN_TYPE();
+}
+
+void readback_ring::set_callback(vulkan_display::frame_capture_callback* callback) {
+        std::scoped_lock lock(callback_mutex);
+        this->callback = callback;
+        enabled = callback != nullptr;
+}
+
+RETURN_TYPE readback_ring::resize_buffer(buffer& buffer, vk::Extent2D size, vk::Format format) {
+        vk::DeviceSize pixel_size = get_pixel_size(format);
+        CHECK(pixel_size != 0, "Format of the swapchain cannot be captured.");
+        vk::DeviceSize row_pitch = size.width * pixel_size;
+        vk::DeviceSize byte_size = row_pitch * size.height;
+        if (byte_size > buffer.byte_size) {
+                device.destroy(buffer.buffer);
+                device.freeMemory(buffer.memory);
+                buffer.buffer = nullptr;
+                buffer.memory = nullptr;
+                buffer.byte_size = 0;
+
+                void* ptr = nullptr;
+                // cached memory is much faster for reading by the cpu
+                PASS_RESULT(create_host_buffer(buffer.buffer, buffer.memory, ptr, device, gpu, byte_size,
+                        vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostCached));
+                buffer.ptr = static_cast<std::byte*>(ptr);
+                buffer.byte_size = byte_size;
+        }
+        buffer.size = size;
+        buffer.format = format;
+        buffer.row_pitch = row_pitch;
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE readback_ring::acquire_buffer(buffer*& result, vk::Extent2D size, vk::Format format, uint64_t frame_number) {
+        result = nullptr;
+        auto free_buffer = free_buffers.try_pop();
+        if (!free_buffer.has_value()) {
+                dropped_frames++;
+                return RETURN_TYPE();
+        }
+        // free buffer isn't used by the gpu, its frame was already waited by the worker
+        buffer& buffer = **free_buffer;
+        PASS_RESULT(resize_buffer(buffer, size, format));
+        buffer.frame_number = frame_number;
+        result = &buffer;
+        return RETURN_TYPE();
+}
+
+void readback_ring::record_copy(vk::CommandBuffer cmd_buffer, buffer& buffer, vk::Image swapchain_image) {
+        using layout = vk::ImageLayout;
+        using access = vk::AccessFlagBits;
+        using stage = vk::PipelineStageFlagBits;
+
+        vk::ImageMemoryBarrier image_barrier{};
+        image_barrier
+                .setImage(swapchain_image)
+                .setOldLayout(layout::ePresentSrcKHR)
+                .setNewLayout(layout::eTransferSrcOptimal)
+                .setSrcAccessMask(access::eColorAttachmentWrite)
+                .setDstAccessMask(access::eTransferRead)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        image_barrier.subresourceRange
+                .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                .setLevelCount(1)
+                .setLayerCount(1);
+        cmd_buffer.pipelineBarrier(stage::eColorAttachmentOutput, stage::eTransfer,
+                vk::DependencyFlags{}, nullptr, nullptr, image_barrier);
+
+        vk::BufferImageCopy copy_region{};
+        copy_region
+                .setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 })
+                .setImageExtent({ buffer.size.width, buffer.size.height, 1 });
+        cmd_buffer.copyImageToBuffer(swapchain_image, layout::eTransferSrcOptimal, buffer.buffer, copy_region);
+
+        image_barrier
+                .setOldLayout(layout::eTransferSrcOptimal)
+                .setNewLayout(layout::ePresentSrcKHR)
+                .setSrcAccessMask(access::eTransferRead)
+                .setDstAccessMask(vk::AccessFlags{});
+        vk::BufferMemoryBarrier buffer_barrier{};
+        buffer_barrier
+                .setBuffer(buffer.buffer)
+                .setSize(VK_WHOLE_SIZE)
+                .setSrcAccessMask(access::eTransferWrite)
+                .setDstAccessMask(access::eHostRead)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        cmd_buffer.pipelineBarrier(stage::eTransfer, stage::eHost | stage::eBottomOfPipe,
+                vk::DependencyFlags{}, nullptr, buffer_barrier, image_barrier);
+}
+
+void readback_ring::submit(buffer& buffer) {
+        pending_buffers.push(&buffer);
+}
+
+void readback_ring::run() {
+        while (true) {
+                buffer* pending = pending_buffers.pop();
+                if (!pending) {
+                        return;
+                }
+                // host wait on the timeline doesn't need any synchronization with the display thread
+                vk::SemaphoreWaitInfo wait_info{};
+                wait_info
+                        .setSemaphoreCount(1)
+                        .setPSemaphores(&timeline)
+                        .setPValues(&pending->frame_number);
+                auto result = device.waitSemaphores(wait_info, UINT64_MAX);
+                if (result == vk::Result::eSuccess) {
+                        std::scoped_lock lock(callback_mutex);
+                        if (callback) {
+                                callback->frame_captured(vulkan_display::captured_frame{
+                                        pending->ptr, pending->size, pending->format, pending->row_pitch, pending->frame_number });
+                                captured_frames++;
+                        }
+                }
+                free_buffers.push(pending);
+        }
+}
+
+void readback_ring::destroy() {
+        if (worker.joinable()) {
+                pending_buffers.push(nullptr);
+                worker.join();
+        }
+        for (auto& buffer : buffers) {
+                device.destroy(buffer.buffer);
+                device.freeMemory(buffer.memory);
+        }
+        while (free_buffers.try_pop().has_value()) {}
+        buffers.clear();
+        callback = nullptr;
+        enabled = false;
+}
+
+} // vulkan_display_detail
@@ -0,0 +1,108 @@
+#pragma once
+#include "concurent_queue.h"
+#include "vulkan_context.h"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vulkan_display {
+
+struct captured_frame {
+        const std::byte* data;
+        vk::Extent2D size;
+        vk::Format format;              ///< format of the swapchain images
+        vk::DeviceSize row_pitch;
+        uint64_t frame_number;          ///< number of the displayed frame, gaps are dropped frames
+};
+
+class frame_capture_callback {
+protected:
+        ~frame_capture_callback() = default;
+public:
+        /// called from the capture thread, data are valid only during the call
+        virtual void frame_captured(const captured_frame& frame) = 0;
+};
+
+struct capture_statistics {
+        uint64_t captured_frames = 0;
+        uint64_t dropped_frames = 0;    ///< frames not captured because all buffers were used by the consumer
+};
+
+} // vulkan_display
+
+namespace vulkan_display_detail {
+
+/**
+ * Ring of host visible buffers, presented images are copied into them by the display thread
+ * and they are delivered to the callback by a worker thread after the gpu finishes the copy
+ */
+class readback_ring {
+public:
+        struct buffer {
+                vk::Buffer buffer;
+                vk::DeviceMemory memory;
+                std::byte* ptr = nullptr;
+                vk::DeviceSize byte_size = 0;
+                vk::Extent2D size{};
+                vk::Format format{};
+                vk::DeviceSize row_pitch = 0;
+                uint64_t frame_number = 0; ///< value of the queue timeline signaled by the frame
+        };
+
+private:
+        vk::Device device;
+        vk::PhysicalDevice gpu;
+        vk::Semaphore timeline;
+        std::vector<buffer> buffers{};
+        concurrent_queue<buffer*> free_buffers{};
+        concurrent_queue<buffer*> pending_buffers{}; // nullptr stops the worker thread
+        std::thread worker{};
+
+        std::mutex callback_mutex{};
+        vulkan_display::frame_capture_callback* callback = nullptr;
+        std::atomic<bool> enabled = false;
+        std::atomic<uint64_t> captured_frames = 0;
+        std::atomic<uint64_t> dropped_frames = 0;
+
+        void run();
+
+        RETURN_TYPE resize_buffer(buffer& buffer, vk::Extent2D size, vk::Format format);
+
+public:
+        RETURN_TYPE init(vk::Device device, vk::PhysicalDevice gpu, vk::Semaphore timeline, uint32_t buffer_count);
+
+        bool is_initialised() const {
+                return !buffers.empty();
+        }
+
+        /// after the function returns, the previous callback is not called anymore
+        void set_callback(vulkan_display::frame_capture_callback* callback);
+
+        bool is_enabled() const {
+                return enabled;
+        }
+
+        /// never waits, result is nullptr and the frame is counted as dropped if no buffer is free
+        RETURN_TYPE acquire_buffer(buffer*& result, vk::Extent2D size, vk::Format format, uint64_t frame_number);
+
+        /**
+         * Must be recorded after the render pass, swapchain image is in layout ePresentSrcKHR
+         * before and after the commands are executed
+         */
+        void record_copy(vk::CommandBuffer cmd_buffer, buffer& buffer, vk::Image swapchain_image);
+
+        /// has to be called after the submission of the recorded copy
+        void submit(buffer& buffer);
+
+        vulkan_display::capture_statistics get_statistics() const {
+                return { captured_frames, dropped_frames };
+        }
+
+        /// gpu mustn't use the buffers anymore
+        void destroy();
+};
+
+} // vulkan_display_detail
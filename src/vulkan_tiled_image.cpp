@@ -0,0 +1,527 @@
+#include "vulkan_tiled_image.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <tuple>
+
+using namespace vulkan_display_detail;
+
+namespace {
+
+uint64_t tile_key(uint32_t level, uint32_t tile_x, uint32_t tile_y) {
+        return (uint64_t{ level } << 56) | (uint64_t{ tile_y } << 28) | uint64_t{ tile_x };
+}
+
+uint32_t level_size(uint32_t size, uint32_t level) {
+        return (size + (1u << level) - 1) >> level;
+}
+
+struct tile_range {
+        uint32_t first_x;
+        uint32_t first_y;
+        uint32_t last_x;
+        uint32_t last_y;
+};
+
+/// tiles of the level intersecting the rectangle given in texels of the level 0
+tile_range get_tile_range(vk::Extent2D size, uint32_t level, uint32_t tile_size,
+        double left, double top, double right, double bottom)
+{
+        double tile_extent = static_cast<double>(uint64_t{ tile_size } << level);
+        uint32_t tiles_x = (level_size(size.width, level) + tile_size - 1) / tile_size;
+        uint32_t tiles_y = (level_size(size.height, level) + tile_size - 1) / tile_size;
+        tile_range range{};
+        range.first_x = std::min(static_cast<uint32_t>(left / tile_extent), tiles_x - 1);
+        range.first_y = std::min(static_cast<uint32_t>(top / tile_extent), tiles_y - 1);
+        range.last_x = std::min(static_cast<uint32_t>(std::ceil(right / tile_extent)), tiles_x) - 1;
+        range.last_y = std::min(static_cast<uint32_t>(std::ceil(bottom / tile_extent)), tiles_y) - 1;
+        return range;
+}
+
+vk::ImageMemoryBarrier create_layer_barrier(vk::Image image, uint32_t layer,
+        vk::ImageLayout old_layout, vk::ImageLayout new_layout,
+        vk::AccessFlags old_access, vk::AccessFlags new_access)
+{
+        vk::ImageMemoryBarrier memory_barrier{};
+        memory_barrier
+                .setImage(image)
+                .setOldLayout(old_layout)
+                .setNewLayout(new_layout)
+                .setSrcAccessMask(old_access)
+                .setDstAccessMask(new_access)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED);
+        memory_barrier.subresourceRange
+                .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                .setLevelCount(1)
+                .setBaseArrayLayer(layer)
+                .setLayerCount(1);
+        return memory_barrier;
+}
+
+} //namespace -------------------------------------------------------------
+
+namespace vulkan_display_detail {
+
+RETURN_TYPE tiled_image::init(vk::Device device, vk::RenderPass render_pass,
+        vk::ShaderModule vertex_shader, vk::ShaderModule fragment_shader)
+{
+        vk::SamplerCreateInfo sampler_info;
+        sampler_info
+                .setAddressModeU(vk::SamplerAddressMode::eClampToEdge)
+                .setAddressModeV(vk::SamplerAddressMode::eClampToEdge)
+                .setAddressModeW(vk::SamplerAddressMode::eClampToEdge)
+                .setMagFilter(vk::Filter::eLinear)
+                .setMinFilter(vk::Filter::eLinear)
+                .setAnisotropyEnable(false)
+                .setUnnormalizedCoordinates(false);
+        CHECKED_ASSIGN(sampler, device.createSampler(sampler_info));
+
+        vk::DescriptorSetLayoutBinding binding;
+        binding
+                .setBinding(0)
+                .setDescriptorCount(1)
+                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                .setStageFlags(vk::ShaderStageFlagBits::eFragment)
+                .setPImmutableSamplers(&sampler);
+        vk::DescriptorSetLayoutCreateInfo descriptor_set_layout_info{};
+        descriptor_set_layout_info
+                .setBindingCount(1)
+                .setPBindings(&binding);
+        CHECKED_ASSIGN(descriptor_set_layout, device.createDescriptorSetLayout(descriptor_set_layout_info));
+
+        vk::DescriptorPoolSize descriptor_sizes{ vk::DescriptorType::eCombinedImageSampler, 1 };
+        vk::DescriptorPoolCreateInfo pool_info{};
+        pool_info
+                .setPoolSizeCount(1)
+                .setPPoolSizes(&descriptor_sizes)
+                .setMaxSets(1);
+        CHECKED_ASSIGN(descriptor_pool, device.createDescriptorPool(pool_info));
+
+        vk::DescriptorSetAllocateInfo allocate_info;
+        allocate_info
+                .setDescriptorPool(descriptor_pool)
+                .setDescriptorSetCount(1)
+                .setPSetLayouts(&descriptor_set_layout);
+        std::vector<vk::DescriptorSet> descriptor_sets;
+        CHECKED_ASSIGN(descriptor_sets, device.allocateDescriptorSets(allocate_info));
+        descriptor_set = descriptor_sets[0];
+
+        PASS_RESULT(create_pipeline(device, render_pass, vertex_shader, fragment_shader));
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE tiled_image::create_pipeline(vk::Device device, vk::RenderPass render_pass,
+        vk::ShaderModule vertex_shader, vk::ShaderModule fragment_shader)
+{
+        vk::PipelineLayoutCreateInfo pipeline_layout_info{};
+        pipeline_layout_info
+                .setSetLayoutCount(1)
+                .setPSetLayouts(&descriptor_set_layout);
+        CHECKED_ASSIGN(pipeline_layout, device.createPipelineLayout(pipeline_layout_info));
+
+        vk::GraphicsPipelineCreateInfo pipeline_info{};
+
+        std::array<vk::PipelineShaderStageCreateInfo, 2> shader_stages_infos;
+        shader_stages_infos[0]
+                .setModule(vertex_shader)
+                .setPName("main")
+                .setStage(vk::ShaderStageFlagBits::eVertex);
+        shader_stages_infos[1]
+                .setModule(fragment_shader)
+                .setPName("main")
+                .setStage(vk::ShaderStageFlagBits::eFragment);
+        pipeline_info
+                .setStageCount(static_cast<uint32_t>(shader_stages_infos.size()))
+                .setPStages(shader_stages_infos.data());
+
+        vk::VertexInputBindingDescription instance_binding{ 0, sizeof(tile_instance), vk::VertexInputRate::eInstance };
+        std::array<vk::VertexInputAttributeDescription, 4> instance_attributes{
+                vk::VertexInputAttributeDescription{ 0, 0, vk::Format::eR32G32B32A32Sfloat, offsetof(tile_instance, screen_rect) },
+                vk::VertexInputAttributeDescription{ 1, 0, vk::Format::eR32G32B32A32Sfloat, offsetof(tile_instance, texture_rect) },
+                vk::VertexInputAttributeDescription{ 2, 0, vk::Format::eR32Sfloat, offsetof(tile_instance, layer) },
+                vk::VertexInputAttributeDescription{ 3, 0, vk::Format::eR32G32B32A32Sfloat, offsetof(tile_instance, texture_bounds) }
+        };
+        vk::PipelineVertexInputStateCreateInfo vertex_input_state_info{};
+        vertex_input_state_info
+                .setVertexBindingDescriptionCount(1)
+                .setPVertexBindingDescriptions(&instance_binding)
+                .setVertexAttributeDescriptionCount(static_cast<uint32_t>(instance_attributes.size()))
+                .setPVertexAttributeDescriptions(instance_attributes.data());
+        pipeline_info.setPVertexInputState(&vertex_input_state_info);
+
+        vk::PipelineInputAssemblyStateCreateInfo input_assembly_state_info{};
+        input_assembly_state_info.setTopology(vk::PrimitiveTopology::eTriangleList);
+        pipeline_info.setPInputAssemblyState(&input_assembly_state_info);
+
+        vk::PipelineViewportStateCreateInfo viewport_state_info;
+        viewport_state_info
+                .setScissorCount(1)
+                .setViewportCount(1);
+        pipeline_info.setPViewportState(&viewport_state_info);
+
+        vk::PipelineRasterizationStateCreateInfo rasterization_info{};
+        rasterization_info
+                .setPolygonMode(vk::PolygonMode::eFill)
+                .setLineWidth(1.f);
+        pipeline_info.setPRasterizationState(&rasterization_info);
+
+        vk::PipelineMultisampleStateCreateInfo multisample_info;
+        multisample_info
+                .setSampleShadingEnable(false)
+                .setRasterizationSamples(vk::SampleCountFlagBits::e1);
+        pipeline_info.setPMultisampleState(&multisample_info);
+
+        using color_flags = vk::ColorComponentFlagBits;
+        vk::PipelineColorBlendAttachmentState color_blend_attachment{};
+        color_blend_attachment
+                .setBlendEnable(false)
+                .setColorWriteMask(color_flags::eR | color_flags::eG | color_flags::eB | color_flags::eA);
+        vk::PipelineColorBlendStateCreateInfo color_blend_info{};
+        color_blend_info
+                .setAttachmentCount(1)
+                .setPAttachments(&color_blend_attachment);
+        pipeline_info.setPColorBlendState(&color_blend_info);
+
+        std::array dynamic_states{ vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+        vk::PipelineDynamicStateCreateInfo dynamic_state_info{};
+        dynamic_state_info
+                .setDynamicStateCount(static_cast<uint32_t>(dynamic_states.size()))
+                .setPDynamicStates(dynamic_states.data());
+        pipeline_info.setPDynamicState(&dynamic_state_info);
+
+        pipeline_info
+                .setLayout(pipeline_layout)
+                .setRenderPass(render_pass);
+
+        vk::Result result;
+        std::tie(result, pipeline) = device.createGraphicsPipeline(VK_NULL_HANDLE, pipeline_info);
+        CHECK(result, "Tile pipeline cannot be created.");
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE tiled_image::create_cache(vk::Device device, vk::PhysicalDevice gpu) {
+        vk::ImageCreateInfo image_info;
+        image_info
+                .setImageType(vk::ImageType::e2D)
+                .setExtent(vk::Extent3D{ parameters.tile_size, parameters.tile_size, 1 })
+                .setMipLevels(1)
+                .setArrayLayers(parameters.cache_tile_count)
+                .setFormat(format)
+                .setTiling(vk::ImageTiling::eOptimal)
+                .setInitialLayout(vk::ImageLayout::eUndefined)
+                .setUsage(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setSamples(vk::SampleCountFlagBits::e1);
+        CHECKED_ASSIGN(cache_image, device.createImage(image_info));
+
+        vk::MemoryRequirements memory_requirements = device.getImageMemoryRequirements(cache_image);
+        uint32_t memory_type = 0;
+        PASS_RESULT(get_memory_type(memory_type, memory_requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags{}, gpu));
+        vk::MemoryAllocateInfo allocate_info{ memory_requirements.size, memory_type };
+        CHECKED_ASSIGN(cache_memory, device.allocateMemory(allocate_info));
+        PASS_RESULT(device.bindImageMemory(cache_image, cache_memory, 0));
+
+        vk::ImageViewCreateInfo view_info = vulkan_display::default_image_view_create_info(format);
+        view_info
+                .setImage(cache_image)
+                .setViewType(vk::ImageViewType::e2DArray);
+        view_info.subresourceRange.setLayerCount(parameters.cache_tile_count);
+        CHECKED_ASSIGN(cache_view, device.createImageView(view_info));
+
+        // layers which were never uploaded aren't sampled, so the layout of the whole image isn't transitioned
+        vk::DescriptorImageInfo descriptor_image_info;
+        descriptor_image_info
+                .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+                .setSampler(sampler)
+                .setImageView(cache_view);
+        vk::WriteDescriptorSet descriptor_writes{};
+        descriptor_writes
+                .setDstBinding(0)
+                .setDstArrayElement(0)
+                .setDescriptorType(vk::DescriptorType::eCombinedImageSampler)
+                .setPImageInfo(&descriptor_image_info)
+                .setDescriptorCount(1)
+                .setDstSet(descriptor_set);
+        device.updateDescriptorSets(descriptor_writes, nullptr);
+
+        cache_layers.assign(parameters.cache_tile_count, cache_layer{});
+        cached_tiles.clear();
+        cached_tiles.reserve(parameters.cache_tile_count);
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE tiled_image::create_buffers(vk::Device device, vk::PhysicalDevice gpu) {
+        void* ptr = nullptr;
+        vk::DeviceSize staging_size = frame_slot_count * parameters.uploads_per_frame * tile_byte_size;
+        PASS_RESULT(create_host_buffer(staging_buffer, staging_memory, ptr, device, gpu,
+                staging_size, vk::BufferUsageFlagBits::eTransferSrc));
+        staging_ptr = reinterpret_cast<std::byte*>(ptr);
+
+        vk::DeviceSize instance_size = frame_slot_count * max_instance_count * sizeof(tile_instance);
+        PASS_RESULT(create_host_buffer(instance_buffer, instance_memory, ptr, device, gpu,
+                instance_size, vk::BufferUsageFlagBits::eVertexBuffer));
+        instance_ptr = reinterpret_cast<tile_instance*>(ptr);
+        return RETURN_TYPE();
+}
+
+RETURN_TYPE tiled_image::set_source(vk::Device device, vk::PhysicalDevice gpu,
+        vulkan_display::tile_source* source, vulkan_display::tiled_image_parameters parameters)
+{
+        assert(is_initialised());
+        destroy_cache(device);
+        this->source = source;
+        if (!source) {
+                return RETURN_TYPE();
+        }
+
+        format = source->get_format();
+        pixel_size = get_pixel_size(format);
+        CHECK(pixel_size != 0, "Format of the tiled image is not supported.");
+
+        auto limits = gpu.getProperties().limits;
+        CHECK(parameters.tile_size > 0 && parameters.tile_size <= limits.maxImageDimension2D, "Invalid tile size.");
+        parameters.cache_tile_count = std::clamp(parameters.cache_tile_count, 1u, limits.maxImageArrayLayers);
+        parameters.uploads_per_frame = std::clamp(parameters.uploads_per_frame, 1u, parameters.cache_tile_count);
+        this->parameters = parameters;
+
+        tile_byte_size = vk::DeviceSize{ parameters.tile_size } * parameters.tile_size * pixel_size;
+        // tile can be drawn only from a cached layer, so there can't be more instances than layers
+        max_instance_count = parameters.cache_tile_count;
+
+        PASS_RESULT(create_cache(device, gpu));
+        PASS_RESULT(create_buffers(device, gpu));
+        return RETURN_TYPE();
+}
+
+uint32_t tiled_image::get_tile_layer(vk::CommandBuffer cmd_buffer, uint32_t level, uint32_t tile_x, uint32_t tile_y,
+        uint32_t& upload_count)
+{
+        uint64_t key = tile_key(level, tile_x, tile_y);
+        auto cached = cached_tiles.find(key);
+        if (cached != cached_tiles.end()) {
+                cache_layers[cached->second].last_used_frame = frame_number;
+                return cached->second;
+        }
+        if (upload_count == parameters.uploads_per_frame) {
+                return NO_LAYER;
+        }
+
+        auto least_recently_used = std::min_element(cache_layers.begin(), cache_layers.end(),
+                [](auto& a, auto& b) { return a.last_used_frame < b.last_used_frame; });
+        if (least_recently_used->last_used_frame == frame_number) {
+                // all layers are needed by this frame
+                return NO_LAYER;
+        }
+        auto layer = static_cast<uint32_t>(least_recently_used - cache_layers.begin());
+        if (least_recently_used->key != UINT64_MAX) {
+                cached_tiles.erase(least_recently_used->key);
+        }
+        least_recently_used->key = key;
+        least_recently_used->last_used_frame = frame_number;
+        cached_tiles.emplace(key, layer);
+
+        vk::DeviceSize offset = (vk::DeviceSize{ slot } * parameters.uploads_per_frame + upload_count) * tile_byte_size;
+        upload_count++;
+        uint32_t tile_size = parameters.tile_size;
+        auto size = source->get_size();
+        uint32_t width = std::min(tile_size, level_size(size.width, level) - tile_x * tile_size);
+        uint32_t height = std::min(tile_size, level_size(size.height, level) - tile_y * tile_size);
+        source->read_tile(level, tile_x, tile_y, staging_ptr + offset, tile_size * pixel_size, tile_size);
+
+        using layout = vk::ImageLayout;
+        using access = vk::AccessFlagBits;
+        using stage = vk::PipelineStageFlagBits;
+        // evicted tile can be still sampled by the previous frame
+        auto upload_barrier = create_layer_barrier(cache_image, layer,
+                layout::eUndefined, layout::eTransferDstOptimal, access::eShaderRead, access::eTransferWrite);
+        cmd_buffer.pipelineBarrier(stage::eFragmentShader, stage::eTransfer,
+                vk::DependencyFlags{}, nullptr, nullptr, upload_barrier);
+
+        vk::BufferImageCopy copy_region{};
+        copy_region
+                .setBufferOffset(offset)
+                .setBufferRowLength(tile_size)
+                .setBufferImageHeight(tile_size)
+                .setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, layer, 1 })
+                .setImageExtent({ width, height, 1 });
+        cmd_buffer.copyBufferToImage(staging_buffer, cache_image, layout::eTransferDstOptimal, copy_region);
+
+        auto sample_barrier = create_layer_barrier(cache_image, layer,
+                layout::eTransferDstOptimal, layout::eShaderReadOnlyOptimal, access::eTransferWrite, access::eShaderRead);
+        cmd_buffer.pipelineBarrier(stage::eTransfer, stage::eFragmentShader,
+                vk::DependencyFlags{}, nullptr, nullptr, sample_barrier);
+        return layer;
+}
+
+RETURN_TYPE tiled_image::record_uploads(vk::CommandBuffer cmd_buffer, uint32_t frame_slot,
+        vk::Extent2D window_size, vulkan_display::tiled_view view)
+{
+        assert(frame_slot < frame_slot_count);
+        instance_count = 0;
+        slot = frame_slot;
+        frame_number++;
+        if (!source || window_size.width * window_size.height == 0) {
+                return RETURN_TYPE();
+        }
+
+        auto size = source->get_size();
+        uint32_t level_count = std::max(source->get_level_count(), 1u);
+        uint32_t tile_size = parameters.tile_size;
+
+        // screen pixels per texel of the level 0
+        double fit_scale = std::min(static_cast<double>(window_size.width) / size.width,
+                static_cast<double>(window_size.height) / size.height);
+        double scale = fit_scale * std::max(view.zoom, 1e-9);
+
+        // level with texels closest to the screen pixels
+        uint32_t level = 0;
+        if (scale < 1.0) {
+                level = std::min(static_cast<uint32_t>(std::round(std::log2(1.0 / scale))), level_count - 1);
+        }
+
+        double center_x = view.center_x * size.width;
+        double center_y = view.center_y * size.height;
+        double left = std::max(center_x - window_size.width / 2.0 / scale, 0.0);
+        double top = std::max(center_y - window_size.height / 2.0 / scale, 0.0);
+        double right = std::min(center_x + window_size.width / 2.0 / scale, static_cast<double>(size.width));
+        double bottom = std::min(center_y + window_size.height / 2.0 / scale, static_cast<double>(size.height));
+        if (right <= left || bottom <= top) {
+                return RETURN_TYPE();
+        }
+
+        // level 0 texels covered by one tile
+        double tile_extent = static_cast<double>(uint64_t{ tile_size } << level);
+        auto range = get_tile_range(size, level, tile_size, left, top, right, bottom);
+
+        // tiles of the coarsest level covering the view are uploaded first and kept cached while visible,
+        // so every tile over the upload budget has an ancestor to be drawn from
+        uint32_t upload_count = 0;
+        uint32_t coarsest_level = level_count - 1;
+        if (coarsest_level != level) {
+                auto coarsest = get_tile_range(size, coarsest_level, tile_size, left, top, right, bottom);
+                for (uint32_t tile_y = coarsest.first_y; tile_y <= coarsest.last_y; tile_y++) {
+                        for (uint32_t tile_x = coarsest.first_x; tile_x <= coarsest.last_x; tile_x++) {
+                                get_tile_layer(cmd_buffer, coarsest_level, tile_x, tile_y, upload_count);
+                        }
+                }
+        }
+
+        tile_instance* instances = instance_ptr + vk::DeviceSize{ slot } * max_instance_count;
+        for (uint32_t tile_y = range.first_y; tile_y <= range.last_y; tile_y++) {
+                for (uint32_t tile_x = range.first_x; tile_x <= range.last_x; tile_x++) {
+                        if (instance_count == max_instance_count) {
+                                break;
+                        }
+                        uint32_t tile_level = level;
+                        uint32_t parent_x = tile_x;
+                        uint32_t parent_y = tile_y;
+                        uint32_t layer = get_tile_layer(cmd_buffer, level, tile_x, tile_y, upload_count);
+                        // tile which isn't uploaded yet is drawn from the closest cached lower level
+                        while (layer == NO_LAYER && tile_level + 1 < level_count) {
+                                tile_level++;
+                                parent_x >>= 1;
+                                parent_y >>= 1;
+                                auto cached = cached_tiles.find(tile_key(tile_level, parent_x, parent_y));
+                                if (cached != cached_tiles.end()) {
+                                        layer = cached->second;
+                                        cache_layers[layer].last_used_frame = frame_number;
+                                }
+                        }
+                        if (layer == NO_LAYER) {
+                                continue;
+                        }
+
+                        uint32_t texels_x = std::min(tile_size, level_size(size.width, level) - tile_x * tile_size);
+                        uint32_t texels_y = std::min(tile_size, level_size(size.height, level) - tile_y * tile_size);
+                        double origin_x = tile_x * tile_extent;
+                        double origin_y = tile_y * tile_extent;
+                        double extent_x = std::min(origin_x + texels_x * std::ldexp(1.0, level), static_cast<double>(size.width)) - origin_x;
+                        double extent_y = std::min(origin_y + texels_y * std::ldexp(1.0, level), static_cast<double>(size.height)) - origin_y;
+
+                        double screen_x = window_size.width / 2.0 + (origin_x - center_x) * scale;
+                        double screen_y = window_size.height / 2.0 + (origin_y - center_y) * scale;
+
+                        // position of the tile inside of the cached tile in texels of the cached level
+                        uint32_t level_difference = tile_level - level;
+                        double divisor = std::ldexp(1.0, level_difference);
+                        double offset_x = (tile_x - (parent_x << level_difference)) * tile_size / divisor;
+                        double offset_y = (tile_y - (parent_y << level_difference)) * tile_size / divisor;
+                        // only the texels of the image are uploaded into a border tile, the rest of the layer is stale
+                        uint32_t cached_texels_x = std::min(tile_size, level_size(size.width, tile_level) - parent_x * tile_size);
+                        uint32_t cached_texels_y = std::min(tile_size, level_size(size.height, tile_level) - parent_y * tile_size);
+
+                        tile_instance& instance = instances[instance_count++];
+                        instance.screen_rect = {
+                                static_cast<float>(screen_x / window_size.width * 2.0 - 1.0),
+                                static_cast<float>(screen_y / window_size.height * 2.0 - 1.0),
+                                static_cast<float>(extent_x * scale / window_size.width * 2.0),
+                                static_cast<float>(extent_y * scale / window_size.height * 2.0) };
+                        instance.texture_rect = {
+                                static_cast<float>(offset_x / tile_size),
+                                static_cast<float>(offset_y / tile_size),
+                                static_cast<float>(texels_x / divisor / tile_size),
+                                static_cast<float>(texels_y / divisor / tile_size) };
+                        instance.layer = static_cast<float>(layer);
+                        instance.texture_bounds = {
+                                0.5f / tile_size,
+                                0.5f / tile_size,
+                                (cached_texels_x - 0.5f) / tile_size,
+                                (cached_texels_y - 0.5f) / tile_size };
+                }
+        }
+        return RETURN_TYPE();
+}
+
+void tiled_image::record_draw(vk::CommandBuffer cmd_buffer, vk::Extent2D window_size) {
+        if (instance_count == 0) {
+                return;
+        }
+        vk::Viewport viewport{ 0.f, 0.f, static_cast<float>(window_size.width), static_cast<float>(window_size.height), 0.f, 1.f };
+        vk::Rect2D scissor{ {0, 0}, window_size };
+        vk::DeviceSize instance_offset = vk::DeviceSize{ slot } * max_instance_count * sizeof(tile_instance);
+
+        cmd_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        cmd_buffer.setViewport(0, viewport);
+        cmd_buffer.setScissor(0, scissor);
+        cmd_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipeline_layout, 0, descriptor_set, nullptr);
+        cmd_buffer.bindVertexBuffers(0, instance_buffer, instance_offset);
+        cmd_buffer.draw(6, instance_count, 0, 0);
+}
+
+void tiled_image::destroy_cache(vk::Device device) {
+        device.destroy(cache_view);
+        device.destroy(cache_image);
+        device.freeMemory(cache_memory);
+        device.destroy(staging_buffer);
+        device.freeMemory(staging_memory);
+        device.destroy(instance_buffer);
+        device.freeMemory(instance_memory);
+        cache_view = nullptr;
+        cache_image = nullptr;
+        cache_memory = nullptr;
+        staging_buffer = nullptr;
+        staging_memory = nullptr;
+        staging_ptr = nullptr;
+        instance_buffer = nullptr;
+        instance_memory = nullptr;
+        instance_ptr = nullptr;
+        cache_layers.clear();
+        cached_tiles.clear();
+        instance_count = 0;
+}
+
+void tiled_image::destroy(vk::Device device) {
+        destroy_cache(device);
+        device.destroy(pipeline);
+        device.destroy(pipeline_layout);
+        device.destroy(descriptor_pool);
+        device.destroy(descriptor_set_layout);
+        device.destroy(sampler);
+        source = nullptr;
+}
+
+} // vulkan_display_detail
@@ -0,0 +1,145 @@
+#pragma once
+#include "vulkan_context.h"
+
+#include <array>
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
+namespace vulkan_display {
+
+/**
+ * Source of an image too large for one vulkan image, tiles are read only when they become visible.
+ * Level 0 has full resolution, every next level is downscaled by 2 in both dimensions.
+ * Functions are called from the thread calling display_tiled_image.
+ */
+class tile_source {
+protected:
+        ~tile_source() = default;
+public:
+        /// size of the level 0
+        virtual vk::Extent2D get_size() = 0;
+
+        /// only formats with 4, 8 or 16 bytes per pixel are supported
+        virtual vk::Format get_format() = 0;
+
+        virtual uint32_t get_level_count() = 0;
+
+        /**
+         * Tiles at the right and bottom border of the level are smaller than tile_size,
+         * size of the level is (size + 2^level - 1) >> level.
+         */
+        virtual void read_tile(uint32_t level, uint32_t tile_x, uint32_t tile_y,
+                std::byte* memory, vk::DeviceSize row_pitch, uint32_t tile_size) = 0;
+};
+
+struct tiled_image_parameters {
+        uint32_t tile_size = 256;
+        uint32_t cache_tile_count = 256;       ///< gpu memory is cache_tile_count * tile_size^2 * pixel size
+        uint32_t uploads_per_frame = 16;       ///< the coarsest level is uploaded first, missing tiles are drawn from it
+};
+
+struct tiled_view {
+        double center_x = 0.5;  ///< relative to the image size
+        double center_y = 0.5;
+        double zoom = 1.0;      ///< 1.0 means the whole image fits into the window
+};
+
+} // vulkan_display
+
+namespace vulkan_display_detail {
+
+class tiled_image {
+public:
+        /// every slot has its own part of staging and instance buffer
+        static constexpr uint32_t frame_slot_count = 2;
+        static constexpr uint32_t NO_LAYER = UINT32_MAX;
+
+private:
+        struct tile_instance {
+                std::array<float, 4> screen_rect;
+                std::array<float, 4> texture_rect;
+                float layer;
+                std::array<float, 4> texture_bounds;
+        };
+
+        struct cache_layer {
+                uint64_t key = UINT64_MAX;
+                uint64_t last_used_frame = 0;
+        };
+
+        vulkan_display::tile_source* source = nullptr;
+        vulkan_display::tiled_image_parameters parameters{};
+        vk::Format format{};
+        vk::DeviceSize pixel_size = 0;
+        vk::DeviceSize tile_byte_size = 0;
+        uint32_t max_instance_count = 0;
+
+        vk::Image cache_image;
+        vk::DeviceMemory cache_memory;
+        vk::ImageView cache_view;
+        std::vector<cache_layer> cache_layers{};
+        std::unordered_map<uint64_t, uint32_t> cached_tiles{};
+
+        vk::Buffer staging_buffer;
+        vk::DeviceMemory staging_memory;
+        std::byte* staging_ptr = nullptr;
+
+        vk::Buffer instance_buffer;
+        vk::DeviceMemory instance_memory;
+        tile_instance* instance_ptr = nullptr;
+
+        vk::Sampler sampler;
+        vk::DescriptorSetLayout descriptor_set_layout;
+        vk::DescriptorPool descriptor_pool;
+        vk::DescriptorSet descriptor_set;
+        vk::PipelineLayout pipeline_layout;
+        vk::Pipeline pipeline;
+
+        uint64_t frame_number = 0;
+        uint32_t instance_count = 0;
+        uint32_t slot = 0;
+
+        RETURN_TYPE create_pipeline(vk::Device device, vk::RenderPass render_pass,
+                vk::ShaderModule vertex_shader, vk::ShaderModule fragment_shader);
+
+        RETURN_TYPE create_cache(vk::Device device, vk::PhysicalDevice gpu);
+
+        RETURN_TYPE create_buffers(vk::Device device, vk::PhysicalDevice gpu);
+
+        void destroy_cache(vk::Device device);
+
+        /// returns cache layer of the tile or NO_LAYER if the tile isn't cached and cannot be uploaded now
+        uint32_t get_tile_layer(vk::CommandBuffer cmd_buffer, uint32_t level, uint32_t tile_x, uint32_t tile_y,
+                uint32_t& upload_count);
+
+public:
+        RETURN_TYPE init(vk::Device device, vk::RenderPass render_pass,
+                vk::ShaderModule vertex_shader, vk::ShaderModule fragment_shader);
+
+        bool is_initialised() const {
+                return static_cast<bool>(pipeline);
+        }
+
+        /// previous source cannot be used by the gpu
+        RETURN_TYPE set_source(vk::Device device, vk::PhysicalDevice gpu,
+                vulkan_display::tile_source* source, vulkan_display::tiled_image_parameters parameters);
+
+        bool has_source() const {
+                return source != nullptr;
+        }
+
+        /**
+         * Uploads missing visible tiles and fills instance buffer, must be recorded outside of the render pass.
+         * Previous use of the frame slot by the gpu has to be finished.
+         */
+        RETURN_TYPE record_uploads(vk::CommandBuffer cmd_buffer, uint32_t frame_slot,
+                vk::Extent2D window_size, vulkan_display::tiled_view view);
+
+        /// draws all visible tiles in one instanced draw call
+        void record_draw(vk::CommandBuffer cmd_buffer, vk::Extent2D window_size);
+
+        void destroy(vk::Device device);
+};
+
+} // vulkan_display_detail
@@ -1,5 +1,8 @@
 #include "vulkan_transfer_image.h"
 
+#include <algorithm>
+#include <iterator>
+
 using namespace vulkan_display_detail;
 
 namespace {
@@ -12,50 +15,28 @@ vk::DeviceSize add_padding(vk::DeviceSize size, vk::DeviceSize allignment) {
         return size + allignment - remainder;
 }
 
+void destroy_allocation(vk::Device device, const transfer_image_allocation& allocation) {
+        device.destroy(allocation.view);
+        device.destroy(allocation.image);
+        device.destroy(allocation.staging_buffer);
 
-/**
- * Check if the required flags are present among the provided flags
- */
-template<typename T>
-bool flags_present(T provided_flags, T required_flags) {
-        return (provided_flags & required_flags) == required_flags;
-}
-
-RETURN_TYPE get_memory_type(
-        uint32_t& memory_type, uint32_t memory_type_bits,
-        vk::MemoryPropertyFlags requested_properties, vk::MemoryPropertyFlags optional_properties,
-        vk::PhysicalDevice gpu)
-{
-        uint32_t possible_memory_type = UINT32_MAX;
-        auto supported_properties = gpu.getMemoryProperties();
-        for (uint32_t i = 0; i < supported_properties.memoryTypeCount; i++) {
-                // if i-th bit in memory_type_bits is set, than i-th memory type can be used
-                bool is_type_usable = (1u << i) & memory_type_bits;
-                auto& mem_type = supported_properties.memoryTypes[i];
-                if (flags_present(mem_type.propertyFlags, requested_properties) && is_type_usable) {
-                        if (flags_present(mem_type.propertyFlags, optional_properties)) {
-                                memory_type = i;
-                                return RETURN_TYPE();
-                        }
-                        possible_memory_type = i;
-                }
-        }
-        if (possible_memory_type != UINT32_MAX) {
-                memory_type = possible_memory_type;
-                return RETURN_TYPE();
+        // only the staging memory is mapped if the image has any
+        if (allocation.staging_memory) {
+                device.unmapMemory(allocation.staging_memory);
+                device.freeMemory(allocation.staging_memory);
+                device.freeMemory(allocation.memory);
+        } else if (allocation.memory) {
+                device.unmapMemory(allocation.memory);
+                device.freeMemory(allocation.memory);
         }
-        CHECK(false, "No available memory for transfer images found.");
-        return RETURN_TYPE();
 }
 
 } //namespace -------------------------------------------------------------
 
 namespace vulkan_display_detail{
 
-RETURN_TYPE transfer_image::init(vk::Device device, uint32_t id) {
+RETURN_TYPE transfer_image::init([[maybe_unused]] vk::Device device, uint32_t id) {
         this->id = id;
-        vk::FenceCreateInfo fence_info{ vk::FenceCreateFlagBits::eSignaled };
-        CHECKED_ASSIGN(is_available_fence, device.createFence(fence_info));
         return RETURN_TYPE();
 }
 
@@ -63,12 +44,17 @@ RETURN_TYPE transfer_image::create(vk::Device device, vk::PhysicalDevice gpu,
         vulkan_display::image_description description)
 {
         assert(id != NO_ID);
-        destroy(device, false);
+        destroy(device);
 
         this->description = description;
+        this->update_desciptor_set = true;
+        vk::DeviceSize block_size = get_compressed_block_size(description.format);
+        if (block_size != 0) {
+                PASS_RESULT(create_staged(device, gpu, block_size));
+                return RETURN_TYPE();
+        }
         this->layout = vk::ImageLayout::ePreinitialized;
         this->access = vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eHostRead;
-        this->update_desciptor_set = true;
 
         vk::ImageCreateInfo image_info;
         image_info
@@ -79,7 +65,8 @@ RETURN_TYPE transfer_image::create(vk::Device device, vk::PhysicalDevice gpu,
                 .setFormat(description.format)
                 .setTiling(vk::ImageTiling::eLinear)
                 .setInitialLayout(vk::ImageLayout::ePreinitialized)
-                .setUsage(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst)
+                .setUsage(vk::ImageUsageFlagBits::eSampled
+                        | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc)
                 .setSharingMode(vk::SharingMode::eExclusive)
                 .setSamples(vk::SampleCountFlagBits::e1);
         CHECKED_ASSIGN(image, device.createImage(image_info));
@@ -94,6 +81,7 @@ RETURN_TYPE transfer_image::create(vk::Device device, vk::PhysicalDevice gpu,
 
         vk::MemoryAllocateInfo allocInfo{ byte_size , memory_type };
         CHECKED_ASSIGN(memory, device.allocateMemory(allocInfo));
+        memory_size = byte_size;
 
         PASS_RESULT(device.bindImageMemory(image, memory, 0));
 
@@ -111,6 +99,74 @@ RETURN_TYPE transfer_image::create(vk::Device device, vk::PhysicalDevice gpu,
         return RETURN_TYPE();
 }
 
+RETURN_TYPE transfer_image::create_staged(vk::Device device, vk::PhysicalDevice gpu, vk::DeviceSize block_size) {
+        using feature_bits = vk::FormatFeatureFlagBits;
+        auto features = gpu.getFormatProperties(description.format).optimalTilingFeatures;
+        CHECK((features & (feature_bits::eSampledImage | feature_bits::eTransferDst)) ==
+                (feature_bits::eSampledImage | feature_bits::eTransferDst),
+                "Compressed format "s + vk::to_string(description.format) + " cannot be sampled by the gpu.");
+        this->layout = vk::ImageLayout::eUndefined;
+        this->access = vk::AccessFlags{};
+
+        vk::ImageCreateInfo image_info;
+        image_info
+                .setImageType(vk::ImageType::e2D)
+                .setExtent(vk::Extent3D{ description.size, 1 })
+                .setMipLevels(1)
+                .setArrayLayers(1)
+                .setFormat(description.format)
+                .setTiling(vk::ImageTiling::eOptimal)
+                .setInitialLayout(vk::ImageLayout::eUndefined)
+                .setUsage(vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst)
+                .setSharingMode(vk::SharingMode::eExclusive)
+                .setSamples(vk::SampleCountFlagBits::e1);
+        CHECKED_ASSIGN(image, device.createImage(image_info));
+
+        vk::MemoryRequirements memory_requirements = device.getImageMemoryRequirements(image);
+        uint32_t memory_type = 0;
+        PASS_RESULT(get_memory_type(memory_type, memory_requirements.memoryTypeBits,
+                vk::MemoryPropertyFlagBits::eDeviceLocal, vk::MemoryPropertyFlags{}, gpu));
+        vk::MemoryAllocateInfo allocate_info{ memory_requirements.size, memory_type };
+        CHECKED_ASSIGN(memory, device.allocateMemory(allocate_info));
+        PASS_RESULT(device.bindImageMemory(image, memory, 0));
+
+        // blocks are tightly packed in the staging buffer
+        uint32_t block_columns = (description.size.width + compressed_block_extent - 1) / compressed_block_extent;
+        uint32_t block_rows = (description.size.height + compressed_block_extent - 1) / compressed_block_extent;
+        row_pitch = block_columns * block_size;
+        vk::DeviceSize staging_size = row_pitch * block_rows;
+        void* void_ptr = nullptr;
+        PASS_RESULT(create_host_buffer(staging_buffer, staging_memory, void_ptr, device, gpu,
+                staging_size, vk::BufferUsageFlagBits::eTransferSrc));
+        ptr = reinterpret_cast<std::byte*>(void_ptr);
+        memory_size = memory_requirements.size + staging_size;
+
+        vk::ImageViewCreateInfo view_info = vulkan_display::default_image_view_create_info(description.format);
+        view_info.setImage(image);
+        CHECKED_ASSIGN(view, device.createImageView(view_info));
+        return RETURN_TYPE();
+}
+
+void transfer_image::record_upload(vk::CommandBuffer cmd_buffer) {
+        assert(is_staged());
+        // the whole image is overwritten, so its previous content is discarded
+        layout = vk::ImageLayout::eUndefined;
+        access = vk::AccessFlags{};
+        auto transfer_barrier = create_memory_barrier(vk::ImageLayout::eTransferDstOptimal, vk::AccessFlagBits::eTransferWrite);
+        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer,
+                vk::DependencyFlags{}, nullptr, nullptr, transfer_barrier);
+
+        vk::BufferImageCopy copy_region{};
+        copy_region
+                .setImageSubresource({ vk::ImageAspectFlagBits::eColor, 0, 0, 1 })
+                .setImageExtent({ description.size.width, description.size.height, 1 });
+        cmd_buffer.copyBufferToImage(staging_buffer, image, vk::ImageLayout::eTransferDstOptimal, copy_region);
+
+        auto sample_barrier = create_memory_barrier(vk::ImageLayout::eShaderReadOnlyOptimal, vk::AccessFlagBits::eShaderRead);
+        cmd_buffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eFragmentShader,
+                vk::DependencyFlags{}, nullptr, nullptr, sample_barrier);
+}
+
 vk::ImageMemoryBarrier  transfer_image::create_memory_barrier(
         vk::ImageLayout new_layout, vk::AccessFlags new_access_mask,
         uint32_t src_queue_family_index, uint32_t dst_queue_family_index)
@@ -134,13 +190,15 @@ vk::ImageMemoryBarrier  transfer_image::create_memory_barrier(
         return memory_barrier;
 }
 
-RETURN_TYPE transfer_image::update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler) {
+RETURN_TYPE transfer_image::update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler,
+        vk::ImageLayout image_layout)
+{
         if (update_desciptor_set || sampler != this->sampler) {
                 update_desciptor_set = false;
                 this->sampler = sampler;
                 vk::DescriptorImageInfo description_image_info;
                 description_image_info
-                        .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal)
+                        .setImageLayout(image_layout)
                         .setSampler(sampler)
                         .setImageView(view);
 
@@ -158,23 +216,141 @@ RETURN_TYPE transfer_image::update_description_set(vk::Device device, vk::Descri
         return RETURN_TYPE();
 }
 
-RETURN_TYPE transfer_image::destroy(vk::Device device, bool destroy_fence) {
-        if (is_available_fence) {
-                auto result = device.waitForFences(is_available_fence, true, UINT64_MAX);
-                CHECK(result, "Waiting for transfer image fence failed.");
+RETURN_TYPE transfer_image::destroy(vk::Device device) {
+        destroy_allocation(device, release_allocation());
+        return RETURN_TYPE();
+}
+
+transfer_image_allocation transfer_image::release_allocation() {
+        transfer_image_allocation result{ memory, memory_size, image, view, ptr, row_pitch, description, layout, access,
+                staging_buffer, staging_memory };
+        memory = nullptr;
+        memory_size = 0;
+        staging_buffer = nullptr;
+        staging_memory = nullptr;
+        image = nullptr;
+        view = nullptr;
+        ptr = nullptr;
+        row_pitch = 0;
+        description = {};
+        update_desciptor_set = true;
+        return result;
+}
+
+void transfer_image::set_allocation(const transfer_image_allocation& allocation) {
+        assert(!image);
+        memory = allocation.memory;
+        memory_size = allocation.memory_size;
+        image = allocation.image;
+        view = allocation.view;
+        ptr = allocation.ptr;
+        row_pitch = allocation.row_pitch;
+        description = allocation.description;
+        layout = allocation.layout;
+        access = allocation.access;
+        staging_buffer = allocation.staging_buffer;
+        staging_memory = allocation.staging_memory;
+        update_desciptor_set = true;
+}
+
+void transfer_image_cache::evict_front(vk::Device device) {
+        auto& allocation = allocations.front();
+        allocated_bytes -= allocation.memory_size;
+        destroy_allocation(device, allocation);
+        allocations.erase(allocations.begin());
+        evictions++;
+}
+
+RETURN_TYPE transfer_image_cache::is_memory_tight(bool& result, const vulkan_context& context,
+        vk::DeviceSize required_bytes)
+{
+        result = memory_limit != 0 && allocated_bytes + required_bytes > memory_limit;
+        if (result || !context.memory_budget_supported) {
+                return RETURN_TYPE();
         }
+        // heap of the memory type preferred by transfer_image::create
+        using mem_bits = vk::MemoryPropertyFlagBits;
+        uint32_t memory_type = 0;
+        PASS_RESULT(get_memory_type(memory_type, UINT32_MAX,
+                mem_bits::eHostVisible | mem_bits::eHostCoherent, mem_bits::eHostCached, context.gpu));
+        uint32_t heap_index = context.gpu.getMemoryProperties().memoryTypes[memory_type].heapIndex;
+        std::vector<vulkan_display::memory_heap_usage> heaps;
+        context.get_memory_heap_usage(heaps);
+        result = heaps[heap_index].usage + required_bytes > heaps[heap_index].budget;
+        return RETURN_TYPE();
+}
 
-        device.destroy(view);
-        device.destroy(image);
+RETURN_TYPE transfer_image_cache::prepare_image(bool& prepared, transfer_image& image, const vulkan_context& context,
+        vulkan_display::image_description description)
+{
+        prepared = true;
+        if (image.description == description) {
+                hits++;
+                return RETURN_TYPE();
+        }
+        vk::Device device = context.device;
+        std::scoped_lock lock(mutex);
+        auto previous = image.release_allocation();
+        if (previous.image) {
+                allocations.push_back(previous);
+        }
+        auto it = std::find_if(allocations.rbegin(), allocations.rend(),
+                [&description](auto& allocation) { return allocation.description == description; });
+        if (it != allocations.rend()) {
+                image.set_allocation(*it);
+                allocations.erase(std::next(it).base());
+        }
+        // least recently used allocations are released
+        while (allocations.size() > capacity) {
+                evict_front(device);
+        }
+        if (image.description == description) {
+                hits++;
+                return RETURN_TYPE();
+        }
+        misses++;
 
-        if (memory) {
-                device.unmapMemory(memory);
-                device.freeMemory(memory);
+        // estimate, size of linear images is close to the size of their pixels, compressed images have also a staging buffer
+        vk::DeviceSize required_bytes = 0;
+        if (vk::DeviceSize block_size = get_compressed_block_size(description.format)) {
+                vk::DeviceSize block_count = vk::DeviceSize{ description.size.width + compressed_block_extent - 1 } / compressed_block_extent
+                        * ((description.size.height + compressed_block_extent - 1) / compressed_block_extent);
+                required_bytes = 2 * block_size * block_count;
+        } else {
+                vk::DeviceSize pixel_size = std::max(get_pixel_size(description.format), vk::DeviceSize{ 4 });
+                required_bytes = pixel_size * description.size.width * description.size.height;
         }
-        if (destroy_fence) {
-                device.destroy(is_available_fence);
+        bool tight = false;
+        PASS_RESULT(is_memory_tight(tight, context, required_bytes));
+        while (tight && !allocations.empty()) {
+                evict_front(device);
+                PASS_RESULT(is_memory_tight(tight, context, required_bytes));
         }
+        if (tight) {
+                prepared = false;
+                return RETURN_TYPE();
+        }
+        PASS_RESULT(image.create(device, context.gpu, description));
+        allocated_bytes += image.get_memory_size();
         return RETURN_TYPE();
 }
 
+void transfer_image_cache::release_image(transfer_image& image, vk::Device device) {
+        std::scoped_lock lock(mutex);
+        auto allocation = image.release_allocation();
+        if (allocation.image) {
+                allocations.push_back(allocation);
+        }
+        while (allocations.size() > capacity) {
+                evict_front(device);
+        }
+}
+
+void transfer_image_cache::destroy(vk::Device device) {
+        std::scoped_lock lock(mutex);
+        while (!allocations.empty()) {
+                evict_front(device);
+        }
+}
+
 } //vulkan_display_detail
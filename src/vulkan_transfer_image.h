@@ -1,6 +1,11 @@
 #pragma once
+#include "inplace_function.h"
 #include "vulkan_context.h"
-#include <functional>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <vector>
 
 namespace vulkan_display {
 
@@ -23,17 +28,58 @@ struct image_description {
         }
 };
 
+/// field order is set on every queued image, progressive images are displayed as they are
+enum class field_order : uint32_t {
+        progressive,
+        top_field_first,
+        bottom_field_first,
+};
+
 class image;
 
+/// stores captures of up to 48 bytes inside, so setting the function for every frame never allocates
+using preprocess_function = inplace_function<void(image& image)>;
+
+struct image_cache_statistics {
+        uint64_t hits = 0;      ///< acquired images which didn't need a new allocation
+        uint64_t misses = 0;    ///< acquired images allocated again, because no image of the description was cached
+        uint64_t evictions = 0; ///< cached allocations released because of the capacity, memory limit or budget
+        vk::DeviceSize allocated_bytes = 0;     ///< memory of transfer images and cached allocations
+};
+
 } // vulkan_display-----------------------------------------
 
 namespace vulkan_display_detail {
 
+/// vulkan objects of one transfer image, transfer_image_cache moves them between transfer images
+struct transfer_image_allocation {
+        vk::DeviceMemory memory;
+        vk::DeviceSize memory_size = 0;
+        vk::Image image;
+        vk::ImageView view;
+        std::byte* ptr = nullptr;
+        vk::DeviceSize row_pitch = 0;
+        vulkan_display::image_description description;
+        vk::ImageLayout layout{};
+        vk::AccessFlags access;
+        vk::Buffer staging_buffer;
+        vk::DeviceMemory staging_memory;
+};
+
+/**
+ * Uncompressed images are linear and written by the host directly,
+ * block compressed images can be sampled only with optimal tiling, so they are uploaded from a staging buffer
+ */
 class transfer_image {
         vk::DeviceMemory memory;
+        vk::DeviceSize memory_size = 0;
         vk::Image image;
         vk::ImageLayout layout{};
         vk::AccessFlags access;
+        vk::Buffer staging_buffer;      // only for compressed formats, ptr points into its memory
+        vk::DeviceMemory staging_memory;
+
+        RETURN_TYPE create_staged(vk::Device device, vk::PhysicalDevice gpu, vk::DeviceSize block_size);
 
 public:
         static constexpr uint32_t NO_ID = UINT32_MAX;
@@ -44,14 +90,36 @@ public:
 
         vk::DeviceSize row_pitch = 0;
 
-        bool fence_set = false;       // true if waiting for is_available_fence is neccessary
-        vk::Fence is_available_fence; // is_available_fence isn't signalled when gpu uses the image
+        vk::DeviceSize get_memory_size() const {
+                return memory_size;
+        }
+
+        bool is_staged() const {
+                return static_cast<bool>(staging_buffer);
+        }
+
+        /// rows of compressed images are rows of blocks
+        vk::DeviceSize get_data_size() const {
+                uint32_t row_count = is_staged() ?
+                        (description.size.height + compressed_block_extent - 1) / compressed_block_extent :
+                        description.size.height;
+                return row_pitch * row_count;
+        }
+
+        // value of the queue timeline semaphore signaled by the last submission using the image, 0 if none
+        uint64_t frame_number = 0;
+        std::chrono::steady_clock::time_point queue_time{}; // set by queue_image, used for latency measurement
 
         bool update_desciptor_set = true;
         vk::Sampler sampler;
 
-        using preprocess_function = std::function<void(vulkan_display::image& image)>;
-        preprocess_function preprocess_fun{ nullptr };
+        vulkan_display::preprocess_function preprocess_fun{ nullptr };
+        bool preprocessed = false;    // true if the image was already converted by a preprocess worker
+        vulkan_display::field_order field_order = vulkan_display::field_order::progressive;
+
+        vk::Image get_image() const {
+                return image;
+        }
 
         RETURN_TYPE init(vk::Device device, uint32_t id);
 
@@ -63,10 +131,21 @@ public:
                 uint32_t src_queue_family_index = VK_QUEUE_FAMILY_IGNORED,
                 uint32_t dst_queue_family_index = VK_QUEUE_FAMILY_IGNORED);
 
+        /// copies the staging buffer of a compressed image, the image is then in eShaderReadOnlyOptimal layout
+        void record_upload(vk::CommandBuffer cmd_buffer);
+
         /// update_description_sets should be called everytime before recording the command buffer
-        RETURN_TYPE update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler);
+        RETURN_TYPE update_description_set(vk::Device device, vk::DescriptorSet descriptor_set, vk::Sampler sampler,
+                vk::ImageLayout image_layout = vk::ImageLayout::eShaderReadOnlyOptimal);
 
-        RETURN_TYPE destroy(vk::Device device, bool destroy_fence = true);
+        /// gpu mustn't use the image, frame_number has to be waited first
+        RETURN_TYPE destroy(vk::Device device);
+
+        /// the image is left without any allocation, gpu mustn't use it
+        transfer_image_allocation release_allocation();
+
+        /// the image mustn't have any allocation
+        void set_allocation(const transfer_image_allocation& allocation);
 
         transfer_image() = default;
         transfer_image(vk::Device device, uint32_t id) {
@@ -74,6 +153,55 @@ public:
         }
 };
 
+/**
+ * Keeps allocations of recently used image descriptions, so streams alternating resolutions
+ * don't destroy and allocate transfer images every time the resolution changes
+ */
+class transfer_image_cache {
+        std::mutex mutex{};
+        std::vector<transfer_image_allocation> allocations{}; // the most recently used allocation is at the back
+        uint32_t capacity = 0;
+        vk::DeviceSize memory_limit = 0;
+        std::atomic<uint64_t> hits = 0;
+        std::atomic<uint64_t> misses = 0;
+        std::atomic<uint64_t> evictions = 0;
+        std::atomic<vk::DeviceSize> allocated_bytes = 0;
+
+        /// mutex has to be locked
+        void evict_front(vk::Device device);
+
+        /**
+         * result is true if the new allocation doesn't fit into the memory limit or into the budget of its heap,
+         * required_bytes is only an estimate, the driver can add alignment and padding to the allocation
+         */
+        RETURN_TYPE is_memory_tight(bool& result, const vulkan_context& context, vk::DeviceSize required_bytes);
+
+public:
+        /// memory_limit is the maximal size of transfer images and cached allocations, 0 is unlimited
+        void init(uint32_t capacity, vk::DeviceSize memory_limit) {
+                this->capacity = capacity;
+                this->memory_limit = memory_limit;
+        }
+
+        /**
+         * Replaces the allocation of the image by a cached allocation of the description or creates a new one,
+         * previous allocation is cached. Cached allocations are released first when the memory is tight.
+         * If the new allocation still doesn't fit, prepared is false and the image is left without an allocation.
+         * Gpu mustn't use the image.
+         */
+        RETURN_TYPE prepare_image(bool& prepared, transfer_image& image, const vulkan_context& context,
+                vulkan_display::image_description description);
+
+        /// moves the allocation of a retired image into the cache, gpu mustn't use the image
+        void release_image(transfer_image& image, vk::Device device);
+
+        vulkan_display::image_cache_statistics get_statistics() const {
+                return { hits, misses, evictions, allocated_bytes };
+        }
+
+        void destroy(vk::Device device);
+};
+
 } // vulkan_display_detail
 
 
@@ -89,6 +217,8 @@ public:
         { 
                 assert(image.id != vulkan_display_detail::transfer_image::NO_ID);
                 transfer_image->preprocess_fun = nullptr;
+                transfer_image->preprocessed = false;
+                transfer_image->field_order = field_order::progressive;
         }
 
         uint32_t get_id() {
@@ -106,11 +236,17 @@ public:
                 return transfer_image->description;
         }
 
+        /// row pitch of compressed images is the size of one row of blocks
         vk::DeviceSize get_row_pitch() {
                 assert(transfer_image);
                 return transfer_image->row_pitch;
         }
 
+        vk::DeviceSize get_data_size() {
+                assert(transfer_image);
+                return transfer_image->get_data_size();
+        }
+
         vk::Extent2D get_size() {
                 return transfer_image->description.size;
         }
@@ -119,10 +255,19 @@ public:
                 return transfer_image;
         }
 
-        void set_process_function(std::function<void(image& image)> function) {
+        /// interlaced images are deinterlaced on the gpu by the mode set on the display
+        void set_field_order(field_order order) {
+                transfer_image->field_order = order;
+        }
+
+        void set_process_function(preprocess_function function) {
                 transfer_image->preprocess_fun = std::move(function);
         }
 
+        bool has_process_function() const {
+                return static_cast<bool>(transfer_image->preprocess_fun);
+        }
+
         void preprocess(){
                 if (transfer_image->preprocess_fun) {
                         transfer_image->preprocess_fun(*this);
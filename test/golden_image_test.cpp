@@ -0,0 +1,377 @@
+#include "vulkan_display.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace vkd = vulkan_display;
+namespace chrono = std::chrono;
+
+/**
+ * Renders synthetic frames into a headless surface, so it runs without a window on any driver
+ * supporting VK_EXT_headless_surface, e.g. lavapipe. Presented frames are read back by the frame capture,
+ * reduced to a grid of block averages and compared with test/golden_images.txt.
+ * Run it from the repository root, shaders are loaded from ./shaders.
+ * With --update the signatures of the current run are written as the new goldens.
+ */
+
+#ifdef NO_EXCEPTIONS
+#define TEST_CHECK(expr) {                                                                       \
+        if (vk::Result res = expr; res != vk::Result::eSuccess) {                                \
+                throw std::runtime_error(#expr " failed: " + vulkan_display_error_message);      \
+        }                                                                                        \
+}
+#else
+#define TEST_CHECK(expr) { expr; }
+#endif
+
+namespace {
+
+constexpr uint32_t window_width = 640;
+constexpr uint32_t window_height = 360;
+constexpr uint32_t grid_size = 8;               ///< signature has grid_size^2 blocks with RGB averages
+constexpr int tolerance = 2;                    ///< allowed difference of every block average
+constexpr uint32_t frames_per_case = 8;         ///< frame time is averaged over all frames of the case
+constexpr int attempts_per_case = 3;            ///< the case is displayed again if its last frame wasn't captured
+constexpr auto capture_timeout = chrono::seconds{ 5 };
+const char* golden_path = "test/golden_images.txt";
+
+struct test_case {
+        const char* name;
+        uint32_t width;
+        uint32_t height;
+        vk::Format format;
+        vkd::scaling_filter filter;
+};
+
+// sizes cover upscaling, downscaling, wider and narrower aspect ratios than the window and odd sizes
+const std::array test_cases{
+        test_case{ "rgba8_srgb_720p_bilinear", 1280, 720, vk::Format::eR8G8B8A8Srgb, vkd::scaling_filter::bilinear },
+        test_case{ "rgba8_srgb_small_nearest", 160, 90, vk::Format::eR8G8B8A8Srgb, vkd::scaling_filter::nearest },
+        test_case{ "rgba8_srgb_wide_integer", 200, 90, vk::Format::eR8G8B8A8Srgb, vkd::scaling_filter::integer },
+        test_case{ "bgra8_unorm_4x3_bicubic", 400, 300, vk::Format::eB8G8R8A8Unorm, vkd::scaling_filter::bicubic },
+        test_case{ "bgra8_unorm_portrait_lanczos3", 270, 480, vk::Format::eB8G8R8A8Unorm, vkd::scaling_filter::lanczos3 },
+        test_case{ "rgba16_unorm_odd_bilinear", 333, 111, vk::Format::eR16G16B16A16Unorm, vkd::scaling_filter::bilinear },
+        test_case{ "rgba16_unorm_1080p_edge_adaptive", 1920, 1080, vk::Format::eR16G16B16A16Unorm,
+                vkd::scaling_filter::edge_adaptive },
+};
+
+/**
+ * Every case is followed by a marker frame of one colour drawn with the nearest filter over the whole window,
+ * colours of consecutive markers differ. The capture right before the marker is the last frame of the case.
+ */
+constexpr uint32_t marker_width = 16;
+constexpr uint32_t marker_height = 9;
+constexpr std::array<std::array<uint8_t, 3>, 2> marker_colors{ { { 255, 0, 255 }, { 0, 255, 255 } } };
+
+/// horizontal red gradient, vertical green gradient and blue 16x16 checkerboard, values are in [0, 1]
+std::array<float, 3> pattern_color(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+        float r = width > 1 ? static_cast<float>(x) / static_cast<float>(width - 1) : 0.f;
+        float g = height > 1 ? static_cast<float>(y) / static_cast<float>(height - 1) : 0.f;
+        float b = ((x / 16 + y / 16) % 2 == 0) ? 1.f : 0.25f;
+        return { r, g, b };
+}
+
+void fill_pattern(vkd::image& image, vk::Format format) {
+        auto size = image.get_size();
+        auto row_pitch = static_cast<size_t>(image.get_row_pitch());
+        std::byte* memory = image.get_memory_ptr();
+        for (uint32_t y = 0; y < size.height; y++) {
+                std::byte* row = memory + y * row_pitch;
+                for (uint32_t x = 0; x < size.width; x++) {
+                        auto [r, g, b] = pattern_color(x, y, size.width, size.height);
+                        if (format == vk::Format::eR16G16B16A16Unorm) {
+                                std::array<uint16_t, 4> pixel{ static_cast<uint16_t>(r * 65535.f + 0.5f),
+                                        static_cast<uint16_t>(g * 65535.f + 0.5f), static_cast<uint16_t>(b * 65535.f + 0.5f),
+                                        uint16_t{ 65535 } };
+                                std::memcpy(row + size_t{ x } * sizeof(pixel), pixel.data(), sizeof(pixel));
+                                continue;
+                        }
+                        auto to_byte = [](float value) { return static_cast<uint8_t>(value * 255.f + 0.5f); };
+                        std::array<uint8_t, 4> pixel{ to_byte(r), to_byte(g), to_byte(b), 255 };
+                        if (format == vk::Format::eB8G8R8A8Unorm) {
+                                std::swap(pixel[0], pixel[2]);
+                        }
+                        std::memcpy(row + size_t{ x } * sizeof(pixel), pixel.data(), sizeof(pixel));
+                }
+        }
+}
+
+using signature = std::vector<uint8_t>;
+
+/// averages of RGB channels in grid_size x grid_size blocks, swapchain formats have 4 bytes per pixel
+signature compute_signature(const vkd::captured_frame& frame) {
+        bool bgr = frame.format == vk::Format::eB8G8R8A8Unorm || frame.format == vk::Format::eB8G8R8A8Srgb;
+        signature result(size_t{ grid_size } * grid_size * 3);
+        for (uint32_t block_y = 0; block_y < grid_size; block_y++) {
+                for (uint32_t block_x = 0; block_x < grid_size; block_x++) {
+                        uint32_t x_begin = frame.size.width * block_x / grid_size;
+                        uint32_t x_end = frame.size.width * (block_x + 1) / grid_size;
+                        uint32_t y_begin = frame.size.height * block_y / grid_size;
+                        uint32_t y_end = frame.size.height * (block_y + 1) / grid_size;
+                        std::array<uint64_t, 3> sums{};
+                        for (uint32_t y = y_begin; y < y_end; y++) {
+                                auto* row = reinterpret_cast<const uint8_t*>(frame.data + y * frame.row_pitch);
+                                for (uint32_t x = x_begin; x < x_end; x++) {
+                                        const uint8_t* pixel = row + size_t{ x } * 4;
+                                        sums[0] += pixel[bgr ? 2 : 0];
+                                        sums[1] += pixel[1];
+                                        sums[2] += pixel[bgr ? 0 : 2];
+                                }
+                        }
+                        uint64_t count = std::max<uint64_t>(uint64_t{ x_end - x_begin } * (y_end - y_begin), 1);
+                        for (size_t channel = 0; channel < 3; channel++) {
+                                result[(size_t{ block_y } * grid_size + block_x) * 3 + channel] =
+                                        static_cast<uint8_t>((sums[channel] + count / 2) / count);
+                        }
+                }
+        }
+        return result;
+}
+
+/// returns the largest difference of block averages
+int max_difference(const signature& a, const signature& b) {
+        int result = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+                result = std::max(result, std::abs(int{ a[i] } - int{ b[i] }));
+        }
+        return result;
+}
+
+/// every block has the colour, the swapchain keeps 8 bit values of a fully saturated colour unchanged
+bool is_marker(const signature& values, const std::array<uint8_t, 3>& color) {
+        for (size_t i = 0; i < values.size(); i++) {
+                if (std::abs(int{ values[i] } - int{ color[i % 3] }) > tolerance) {
+                        return false;
+                }
+        }
+        return true;
+}
+
+std::string to_hex(const signature& values) {
+        std::string result;
+        char digits[3];
+        for (auto value : values) {
+                std::snprintf(digits, sizeof(digits), "%02x", value);
+                result += digits;
+        }
+        return result;
+}
+
+bool from_hex(signature& values, const std::string& hex) {
+        if (hex.size() != size_t{ grid_size } * grid_size * 3 * 2) {
+                return false;
+        }
+        values.resize(hex.size() / 2);
+        for (size_t i = 0; i < values.size(); i++) {
+                values[i] = static_cast<uint8_t>(std::strtoul(hex.substr(i * 2, 2).c_str(), nullptr, 16));
+        }
+        return true;
+}
+
+std::map<std::string, std::string> load_goldens() {
+        std::map<std::string, std::string> goldens;
+        std::ifstream file{ golden_path };
+        std::string line;
+        while (std::getline(file, line)) {
+                std::istringstream stream{ line };
+                std::string name, hex;
+                if (line.empty() || line[0] == '#' || !(stream >> name >> hex)) {
+                        continue;
+                }
+                goldens[name] = hex;
+        }
+        return goldens;
+}
+
+void save_goldens(const std::map<std::string, std::string>& goldens) {
+        std::ofstream file{ golden_path };
+        file << "# name, RGB averages of " << grid_size << "x" << grid_size << " blocks of a "
+                << window_width << "x" << window_height << " frame, written by golden_image_test --update\n";
+        for (auto& [name, hex] : goldens) {
+                file << name << ' ' << hex << '\n';
+        }
+}
+
+class golden_image_test : vkd::window_changed_callback, vkd::frame_capture_callback {
+        vkd::vulkan_display vulkan;
+
+        struct capture {
+                uint64_t frame_number = 0;
+                signature values{};
+        };
+
+        // written by the capture thread
+        std::mutex capture_mutex{};
+        std::condition_variable marker_captured{};
+        size_t expected_marker = 0;     ///< index into marker_colors
+        uint64_t marker_count = 0;      ///< markers of expected_marker colour seen since it was set
+        capture last_capture{};         ///< last frame which isn't a marker
+        capture case_capture{};         ///< frame captured right before the last marker
+
+        vkd::window_parameters get_window_parameters() override {
+                return { window_width, window_height, false };
+        }
+
+        void frame_captured(const vkd::captured_frame& frame) override {
+                capture current{ frame.frame_number, compute_signature(frame) };
+                {
+                        std::scoped_lock lock{ capture_mutex };
+                        if (!is_marker(current.values, marker_colors[expected_marker])) {
+                                last_capture = std::move(current);
+                                return;
+                        }
+                        // the case frame is valid only if no frame between it and the marker was dropped
+                        bool consecutive = last_capture.frame_number + 1 == current.frame_number;
+                        case_capture = consecutive ? last_capture : capture{};
+                        marker_count++;
+                }
+                marker_captured.notify_all();
+        }
+
+        void display(vk::Format format, uint32_t width, uint32_t height, const std::array<uint8_t, 3>* marker) {
+                vkd::image image;
+                TEST_CHECK(vulkan.acquire_image(image, vkd::image_description{ width, height, format }));
+                if (marker) {
+                        for (uint32_t y = 0; y < height; y++) {
+                                for (uint32_t x = 0; x < width; x++) {
+                                        std::array<uint8_t, 4> pixel{ (*marker)[0], (*marker)[1], (*marker)[2], 255 };
+                                        std::memcpy(image.get_memory_ptr() + y * image.get_row_pitch() + size_t{ x } * 4,
+                                                pixel.data(), pixel.size());
+                                }
+                        }
+                } else {
+                        fill_pattern(image, format);
+                }
+                TEST_CHECK(vulkan.queue_image(image));
+                TEST_CHECK(vulkan.display_queued_image());
+        }
+
+        /// returns false if the marker or the frame before it was dropped
+        bool display_marker(signature& result, size_t marker) {
+                {
+                        std::scoped_lock lock{ capture_mutex };
+                        expected_marker = marker;
+                        marker_count = 0;
+                }
+                vulkan.set_scaling_filter(vkd::scaling_filter::nearest);
+                display(vk::Format::eR8G8B8A8Unorm, marker_width, marker_height, &marker_colors[marker]);
+                std::unique_lock lock{ capture_mutex };
+                bool arrived = marker_captured.wait_for(lock, capture_timeout, [this]() { return marker_count > 0; });
+                if (!arrived || case_capture.frame_number == 0) {
+                        return false;
+                }
+                result = case_capture.values;
+                return true;
+        }
+
+public:
+        golden_image_test() {
+                std::vector<const char*> required_extensions{
+                        VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME };
+                TEST_CHECK(vulkan.create_instance(required_extensions, false));
+                VkInstance instance = vulkan.get_instance();
+                auto create_headless_surface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+                        vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT"));
+                if (!create_headless_surface) {
+                        throw std::runtime_error("VK_EXT_headless_surface is not supported.");
+                }
+                VkHeadlessSurfaceCreateInfoEXT surface_info{};
+                surface_info.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+                VkSurfaceKHR surface = VK_NULL_HANDLE;
+                if (create_headless_surface(instance, &surface_info, nullptr, &surface) != VK_SUCCESS) {
+                        throw std::runtime_error("Headless surface cannot be created.");
+                }
+                TEST_CHECK(vulkan.init(surface, 3, this));
+                TEST_CHECK(vulkan.start_frame_capture(this));
+        }
+
+        ~golden_image_test() {
+                vulkan.stop_frame_capture();
+        }
+
+        /// returns the number of failed cases
+        int run(bool update) {
+                auto goldens = load_goldens();
+                int failed = 0;
+                size_t marker = 0;
+                for (auto& test : test_cases) {
+                        signature result;
+                        bool captured = false;
+                        double frame_ms = 0.0;
+                        vkd::gpu_time_statistics gpu_time{};
+                        for (int attempt = 0; !captured && attempt < attempts_per_case; attempt++) {
+                                vulkan.set_scaling_filter(test.filter);
+                                auto gpu_time_before = vulkan.get_gpu_time_statistics(test.filter);
+                                auto start = chrono::steady_clock::now();
+                                for (uint32_t i = 0; i < frames_per_case; i++) {
+                                        display(test.format, test.width, test.height, nullptr);
+                                }
+                                chrono::duration<double, std::milli> elapsed = chrono::steady_clock::now() - start;
+                                frame_ms = elapsed.count() / frames_per_case;
+                                auto gpu_time_after = vulkan.get_gpu_time_statistics(test.filter);
+                                gpu_time.frame_count = gpu_time_after.frame_count - gpu_time_before.frame_count;
+                                gpu_time.total_ms = gpu_time_after.total_ms - gpu_time_before.total_ms;
+                                captured = display_marker(result, marker);
+                                marker = (marker + 1) % marker_colors.size();
+                        }
+                        std::cout << test.name << ": " << frame_ms << " ms per frame, gpu "
+                                << gpu_time.average_ms() << " ms per frame, ";
+                        if (!captured) {
+                                std::cout << "FAILED, frame was not captured\n";
+                                failed++;
+                                continue;
+                        }
+
+                        auto hex = to_hex(result);
+                        auto golden = goldens.find(test.name);
+                        signature expected;
+                        if (update) {
+                                goldens[test.name] = hex;
+                                std::cout << "recorded\n";
+                        } else if (golden == goldens.end() || !from_hex(expected, golden->second)) {
+                                std::cout << "FAILED, no golden, run with --update to record it\n";
+                                std::cout << "        got      " << hex << "\n";
+                                failed++;
+                        } else if (int difference = max_difference(result, expected); difference > tolerance) {
+                                std::cout << "FAILED, block averages differ by " << difference << "\n";
+                                std::cout << "        expected " << golden->second << "\n";
+                                std::cout << "        got      " << hex << "\n";
+                                failed++;
+                        } else {
+                                std::cout << "passed\n";
+                        }
+                }
+                if (update) {
+                        save_goldens(goldens);
+                }
+                return failed;
+        }
+};
+
+} // namespace
+
+int main(int argc, char** argv) {
+        bool update = argc > 1 && std::strcmp(argv[1], "--update") == 0;
+        try {
+                golden_image_test test{};
+                int failed = test.run(update);
+                std::cout << (failed == 0 ? "all cases passed" : std::to_string(failed) + " cases failed") << std::endl;
+                return failed == 0 ? 0 : 1;
+        }
+        catch (std::exception& e) {
+                std::cout << e.what() << std::endl;
+                return 2;
+        }
+}